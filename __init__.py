@@ -14,13 +14,17 @@ from tt_fbx.fbx.dataModel import *
 _dll = api.initialize()
 
 
-def _extractScene(filePath: str, upVector: UpVector, frontVector: FrontVector, coordSystem: CoordSystem, units: Units):
+def _extractScene(filePath: str, upVector: UpVector, frontVector: FrontVector, coordSystem: CoordSystem, units: Units, meshSettings: Optional[MeshExtractSettings], instanceIdenticalMeshes: bool):
     ptr = _dll.importFbx(ctypes.create_string_buffer(filePath.encode('utf-8')), upVector, frontVector, coordSystem, units)
     context: FbxImportContext = ptr.contents
 
     if context.errorCode not in (ErrorCode.OK, ErrorCode.WARNING):
         raise RuntimeError(ErrorCode(context.errorCode).name, context.errorMessage.buffer[:context.errorMessage.length])
 
+    # Must happen before nodes and meshes are extracted, so both agree on the mesh indices
+    if instanceIdenticalMeshes:
+        _dll.instanceIdenticalMeshes(context)
+
     nodeCount = ctypes.c_uint32()
     nodes = _dll.extractNodes(context, ctypes.byref(nodeCount))
 
@@ -28,7 +32,8 @@ def _extractScene(filePath: str, upVector: UpVector, frontVector: FrontVector, c
     takes = _dll.extractTakes(context, 60.0, ctypes.byref(takeCount))
 
     meshCount = ctypes.c_uint32()
-    meshes = _dll.extractMeshes(context, ctypes.byref(meshCount))
+    # None lets the DLL use its default settings
+    meshes = _dll.extractMeshes(context, ctypes.byref(meshSettings) if meshSettings else None, ctypes.byref(meshCount))
 
     # Clean up the FbxScene and FbxManager
     _dll.freeFbx(context)
@@ -144,17 +149,30 @@ _semanticMapping = [
 ]
 
 
-def _writeSubMesh(fh: BinaryWriter, multiMesh: MultiMeshData, meshIndex: int, meshJointInfo: List[int]):
-    mesh: MeshData = multiMesh.meshes[meshIndex]
+def _encodeVertexBuffer(mesh: MeshData) -> ctypes.Array:
+    vertexSize = mesh.vertexDataSizeInBytes // mesh.vertexCount
+    buf = (ctypes.c_uint8 * _dll.encodeVertexBufferBound(mesh.vertexCount, vertexSize))()
+    size = _dll.encodeVertexBuffer(buf, len(buf), mesh.vertexDataBlob, mesh.vertexCount, vertexSize)
+    if not size:
+        raise ValueError('Vertex buffer can not be compressed')
+    return (ctypes.c_uint8 * size).from_buffer(buf)
 
-    # Name
-    name: bytes = multiMesh.name.buffer[:multiMesh.name.length]
-    fh.byteString(name + str(meshIndex).encode('utf-8'))
 
-    # Material id
-    fh.u32(mesh.materialId)
+def _encodeIndexBuffer(mesh: MeshData) -> ctypes.Array:
+    indexCount = mesh.indexDataSizeInBytes // 4
+    buf = (ctypes.c_uint8 * _dll.encodeIndexBufferBound(indexCount))()
+    size = _dll.encodeIndexBuffer(buf, len(buf), mesh.indexDataBlob, indexCount)
+    if not size:
+        raise ValueError('Index buffer can not be compressed, only triangle lists are supported')
+    return (ctypes.c_uint8 * size).from_buffer(buf)
+
 
-    # Attrib layout
+def _writeSubMeshGeometry(fh: BinaryWriter, multiMesh: MultiMeshData, mesh: MeshData, compress: bool):
+    # Attrib layout, the file format has no notion of vertex streams or shared buffers
+    if multiMesh.streamCount != 1:
+        raise ValueError('.mesh files only support interleaved vertex data, use VertexStreamMode.Interleaved')
+    if multiMesh.sharedVertexDataBlob:
+        raise ValueError('.mesh files store a vertex buffer per submesh, do not use MeshExtractFlags.SharedVertexBuffer')
     fh.u8(multiMesh.attributeCount)
     for attributeIndex in range(multiMesh.attributeCount):
         attribute = multiMesh.attributeLayout[attributeIndex]
@@ -165,33 +183,85 @@ def _writeSubMesh(fh: BinaryWriter, multiMesh: MultiMeshData, meshIndex: int, me
     # Prim type
     fh.u32(multiMesh.primitiveType)
 
-    # Blob sizes
+    # Blob sizes, the file format stores them as 32 bit
+    if mesh.vertexDataSizeInBytes > 0xFFFFFFFF or mesh.indexDataSizeInBytes > 0xFFFFFFFF:
+        raise ValueError('.mesh files can not hold submeshes of 4 GiB or more, split the mesh or use the extracted buffers directly')
     fh.u32(mesh.vertexDataSizeInBytes)
     fh.u32(mesh.indexDataSizeInBytes)
     if mesh.indexDataSizeInBytes:
         fh.u8(multiMesh.indexElementSizeInBytes)
 
-    # Blobs
-    buf = ctypes.cast(mesh.vertexDataBlob, ctypes.POINTER(ctypes.c_uint8 * mesh.vertexDataSizeInBytes)).contents
-    fh.write(buf)
+    # Compressed blobs are prefixed by their encoded sizes, the sizes above are the decoded sizes
+    if compress:
+        vertices = _encodeVertexBuffer(mesh) if mesh.vertexCount else (ctypes.c_uint8 * 0)()
+        indices = _encodeIndexBuffer(mesh) if mesh.indexDataSizeInBytes else (ctypes.c_uint8 * 0)()
+        fh.u32(len(vertices))
+        fh.u32(len(indices))
+        fh.write(vertices)
+        fh.write(indices)
+        return
+
+    # Blobs, empty ones are null
+    if mesh.vertexDataSizeInBytes:
+        buf = ctypes.cast(mesh.vertexDataBlob, ctypes.POINTER(ctypes.c_uint8 * mesh.vertexDataSizeInBytes)).contents
+        fh.write(buf)
 
     if mesh.indexDataSizeInBytes:
         buf = ctypes.cast(mesh.indexDataBlob, ctypes.POINTER(ctypes.c_uint8 * mesh.indexDataSizeInBytes)).contents
         fh.write(buf)
 
+
+def _storeSubMeshGeometry(meshCache: str, multiMesh: MultiMeshData, mesh: MeshData, compress: bool):
+    # Geometry is content addressed, so a file that exists already holds exactly these bytes
+    path = os.path.join(meshCache, '%016x%s.geometry' % (mesh.contentHash, '.compressed' if compress else ''))
+    if os.path.exists(path):
+        return
+    # Write next to the final path and move it in place, so concurrent conversions never see a partial file
+    tempPath = '%s.%d.tmp' % (path, os.getpid())
+    with BinaryWriter(tempPath) as fh:
+        _writeSubMeshGeometry(fh, multiMesh, mesh, compress)
+    os.replace(tempPath, path)
+
+
+# Per submesh flags in version 2 .mesh files
+_GEOMETRY_IN_CACHE = 1 << 0
+_GEOMETRY_COMPRESSED = 1 << 1
+
+
+def _writeSubMesh(fh: BinaryWriter, multiMesh: MultiMeshData, meshIndex: int, meshJointInfo: List[int], meshCache: Optional[str], compress: bool):
+    mesh: MeshData = multiMesh.meshes[meshIndex]
+
+    # Name
+    name: bytes = multiMesh.name.buffer[:multiMesh.name.length]
+    fh.byteString(name + str(meshIndex).encode('utf-8'))
+
+    # Material id
+    fh.u32(mesh.materialId)
+
+    # Geometry, or with a cache the hash of the geometry file in it
+    if meshCache or compress:
+        fh.u8((_GEOMETRY_IN_CACHE if meshCache else 0) | (_GEOMETRY_COMPRESSED if compress else 0))
+    if meshCache:
+        _storeSubMeshGeometry(meshCache, multiMesh, mesh, compress)
+        fh.write(ctypes.c_uint64(mesh.contentHash))
+    else:
+        _writeSubMeshGeometry(fh, multiMesh, mesh, compress)
+
     # Joints
     fh.u32(len(meshJointInfo))
     for jointId in meshJointInfo:
         fh.u32(jointId)
 
 
-def _saveMeshes(meshPath: str, meshes, meshCount: ctypes.c_uint32, totalMeshCount: int, indexRemap: Dict[int, int]):
+def _saveMeshes(meshPath: str, meshes, meshCount: ctypes.c_uint32, totalMeshCount: int, indexRemap: Dict[int, int], meshCache: Optional[str], compress: bool):
     # Pre-process
     materialNames, meshJointInfo = _mergeMaterials(meshes, meshCount, indexRemap)
+    if meshCache:
+        os.makedirs(meshCache, exist_ok=True)
 
     with BinaryWriter(meshPath) as fh:
-        # Version
-        fh.string('1')
+        # Version, 2 adds a flags byte per submesh for geometry that is compressed or lives in the mesh cache
+        fh.string('2' if meshCache or compress else '1')
 
         # Material name count
         fh.u32(len(materialNames))
@@ -206,12 +276,17 @@ def _saveMeshes(meshPath: str, meshes, meshCount: ctypes.c_uint32, totalMeshCoun
         for multiMeshIndex in range(meshCount.value):
             multiMesh: MultiMeshData = meshes[multiMeshIndex]
             for meshIndex in range(multiMesh.meshCount):
-                _writeSubMesh(fh, multiMesh, meshIndex, meshJointInfo[meshCursor])
+                _writeSubMesh(fh, multiMesh, meshIndex, meshJointInfo[meshCursor], meshCache, compress)
                 meshCursor += 1
 
 
-def convert(filePath: str, upVector: UpVector = UpVector.Y, frontVector: FrontVector = FrontVector.ParityEven, coordSystem: CoordSystem = CoordSystem.LeftHanded, units: Units = Units.m):
-    nodes, nodeCount, takes, takeCount, meshes, meshCount = _extractScene(filePath, upVector, frontVector, coordSystem, units)
+def convert(filePath: str, upVector: UpVector = UpVector.Y, frontVector: FrontVector = FrontVector.ParityEven, coordSystem: CoordSystem = CoordSystem.LeftHanded, units: Units = Units.m, meshSettings: Optional[MeshExtractSettings] = None, instanceIdenticalMeshes: bool = False, meshCache: Optional[str] = None, compress: bool = False):
+    """
+    meshCache: optional directory shared between conversions. Submesh geometry is stored there once per
+    MeshData.contentHash and the .mesh file only references it, geometry that is already in the cache is not written again.
+    compress: store vertex and index buffers with the DLL codec, see meshCodec.h.
+    """
+    nodes, nodeCount, takes, takeCount, meshes, meshCount = _extractScene(filePath, upVector, frontVector, coordSystem, units, meshSettings, instanceIdenticalMeshes)
 
     # We will combine all meshes into one multi-mesh.
     # Track what FBX mesh ID maps to what range of final output meshes.
@@ -233,7 +308,59 @@ def convert(filePath: str, upVector: UpVector = UpVector.Y, frontVector: FrontVe
     _saveTakes(animPath, takes, takeCount, indexRemap)
 
     # Collapse all the meshes into a single file
-    _saveMeshes(meshPath, meshes, meshCount, totalMeshCount, indexRemap)
+    _saveMeshes(meshPath, meshes, meshCount, totalMeshCount, indexRemap, meshCache, compress)
+
+    _dll.freeTakes(takes, takeCount)
+    _dll.freeNodes(nodes, nodeCount)
+    _dll.freeMeshes(meshes, meshCount)
+
+
+def benchmarkCodec(filePath: str, meshSettings: Optional[MeshExtractSettings] = None, iterations: int = 20):
+    """
+    Print the compression ratio and decode throughput of the mesh codec on the meshes of an FBX file.
+    The codec works best on meshes with OptimizeVertexCache and OptimizeVertexFetch, which are the defaults here.
+    """
+    import time
+
+    if meshSettings is None:
+        meshSettings = MeshExtractSettings()
+        meshSettings.flags = MeshExtractFlags.OptimizeVertexCache | MeshExtractFlags.OptimizeVertexFetch
+    nodes, nodeCount, takes, takeCount, meshes, meshCount = _extractScene(filePath, UpVector.Y, FrontVector.ParityEven, CoordSystem.LeftHanded, Units.m, meshSettings, False)
+
+    rawBytes = [0, 0]
+    encodedBytes = [0, 0]
+    seconds = [0.0, 0.0]
+    for multiMeshIndex in range(meshCount.value):
+        multiMesh: MultiMeshData = meshes[multiMeshIndex]
+        for meshIndex in range(multiMesh.meshCount):
+            mesh: MeshData = multiMesh.meshes[meshIndex]
+            if not mesh.vertexCount or not mesh.indexDataSizeInBytes:
+                continue
+            vertices = _encodeVertexBuffer(mesh)
+            indices = _encodeIndexBuffer(mesh)
+            vertexSize = mesh.vertexDataSizeInBytes // mesh.vertexCount
+            indexCount = mesh.indexDataSizeInBytes // 4
+            vertexTarget = (ctypes.c_uint8 * mesh.vertexDataSizeInBytes)()
+            indexTarget = (ctypes.c_uint32 * indexCount)()
+
+            start = time.perf_counter()
+            for _ in range(iterations):
+                _dll.decodeVertexBuffer(vertexTarget, mesh.vertexCount, vertexSize, vertices, len(vertices))
+            seconds[0] += time.perf_counter() - start
+            start = time.perf_counter()
+            for _ in range(iterations):
+                _dll.decodeIndexBuffer(indexTarget, indexCount, indices, len(indices))
+            seconds[1] += time.perf_counter() - start
+
+            rawBytes[0] += mesh.vertexDataSizeInBytes
+            rawBytes[1] += mesh.indexDataSizeInBytes
+            encodedBytes[0] += len(vertices)
+            encodedBytes[1] += len(indices)
+
+    for label, i in (('vertices', 0), ('indices', 1)):
+        if not rawBytes[i]:
+            continue
+        print('%s: %d -> %d bytes (%.1f%%), decode %.2f GB/s' % (label, rawBytes[i], encodedBytes[i], 100.0 * encodedBytes[i] / rawBytes[i], rawBytes[i] * iterations / max(seconds[i], 1e-9) / 1e9))
 
     _dll.freeTakes(takes, takeCount)
     _dll.freeNodes(nodes, nodeCount)
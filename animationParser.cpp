@@ -49,6 +49,7 @@ namespace {
     void evaluateDouble3Property(
         FbxProperty* channel,
         std::vector<AnimationChannel>& takeResult,
+        TT_FBX::Arena& arena,
         int nodeIndex,
         double start,
         double requestesFramesPerSecond,
@@ -60,9 +61,9 @@ namespace {
         if (channel == nullptr)
             return;
         size_t offset = takeResult.size();
-        takeResult.push_back({ nodeIndex, x, numFrames, new double[numFrames] });
-        takeResult.push_back({ nodeIndex, y, numFrames, new double[numFrames] });
-        takeResult.push_back({ nodeIndex, z, numFrames, new double[numFrames] });
+        takeResult.push_back({ nodeIndex, x, numFrames, arena.allocate<double>(numFrames) });
+        takeResult.push_back({ nodeIndex, y, numFrames, arena.allocate<double>(numFrames) });
+        takeResult.push_back({ nodeIndex, z, numFrames, arena.allocate<double>(numFrames) });
         // For each frame in the take
         for (uint32_t frame = 0; frame < numFrames; ++frame) {
             double buf[3];
@@ -78,6 +79,7 @@ namespace {
     void evaluateRotationProperty(
         FbxProperty* channel,
         std::vector<AnimationChannel>& takeResult,
+        TT_FBX::Arena& arena,
         int nodeIndex,
         double start,
         double requestesFramesPerSecond,
@@ -92,9 +94,9 @@ namespace {
         if (channel == nullptr)
             return;
         size_t offset = takeResult.size();
-        takeResult.push_back({ nodeIndex, x, numFrames, new double[numFrames] });
-        takeResult.push_back({ nodeIndex, y, numFrames, new double[numFrames] });
-        takeResult.push_back({ nodeIndex, z, numFrames, new double[numFrames] });
+        takeResult.push_back({ nodeIndex, x, numFrames, arena.allocate<double>(numFrames) });
+        takeResult.push_back({ nodeIndex, y, numFrames, arena.allocate<double>(numFrames) });
+        takeResult.push_back({ nodeIndex, z, numFrames, arena.allocate<double>(numFrames) });
         // For each frame in the take
         for (uint32_t frame = 0; frame < numFrames; ++frame) {
             double buf[3];
@@ -117,9 +119,14 @@ extern "C" {
             return nullptr;
         }
 
-        std::vector<AnimationChannels> result;
         std::vector<Take> takes = findTakes(context->scene);
 
+        // The result array is the first allocation so freeTakes can find the arena from it,
+        // takes without frames are skipped so it may end up larger than outCount
+        TT_FBX::Arena arena;
+        AnimationChannels* result = arena.allocate<AnimationChannels>(takes.size());
+        uint32_t resultCount = 0;
+
         // For each take
         for(const Take& take : takes) {
             // Enable the take so evaluate calls will use this animation data
@@ -151,27 +158,24 @@ extern "C" {
                 FbxAMatrix postRotation = TT_FBX::matrixFromEuler(rotateOrder, node->PostRotation.Get());
 
                 // Evaluate the animated properties and add the resulting channels to the output take
-                evaluateDouble3Property(translate, takeResult, j, startSeconds, requestedFramesPerSecond, numFrames,
+                evaluateDouble3Property(translate, takeResult, arena, j, startSeconds, requestedFramesPerSecond, numFrames,
                     ChannelIdentifier::TranslateX, ChannelIdentifier::TranslateY, ChannelIdentifier::TranslateZ);
-                evaluateRotationProperty(rotate, takeResult, j, startSeconds, requestedFramesPerSecond, numFrames,
+                evaluateRotationProperty(rotate, takeResult, arena, j, startSeconds, requestedFramesPerSecond, numFrames,
                     ChannelIdentifier::RotateX, ChannelIdentifier::RotateY, ChannelIdentifier::RotateZ, rotateOrder, preRotation, postRotation);
-                evaluateDouble3Property(scale, takeResult, j, startSeconds, requestedFramesPerSecond, numFrames,
+                evaluateDouble3Property(scale, takeResult, arena, j, startSeconds, requestedFramesPerSecond, numFrames,
                     ChannelIdentifier::ScaleX, ChannelIdentifier::ScaleY, ChannelIdentifier::ScaleZ);
             }
 
-            result.push_back({ (uint32_t)takeResult.size(), TT_FBX::flattenList(takeResult) });
+            result[resultCount++] = { (uint32_t)takeResult.size(), arena.flattenList(takeResult) };
         }
 
-        *outCount = (uint32_t)result.size();
-        return TT_FBX::flattenList(result);
+        arena.detach();
+        *outCount = resultCount;
+        return result;
     }
 
-    __declspec(dllexport) void freeTakes(const AnimationChannels* takes, uint32_t takeCount) {
-        for (unsigned int i = 0; i < takeCount; ++i) {
-            for (unsigned int j = 0; j < takes[i].length; ++j)
-                delete[] takes[i].channels[j].data;
-            delete[] takes[i].channels;
-        }
-        delete[] takes;
+    __declspec(dllexport) void freeTakes(const AnimationChannels* takes, uint32_t /*takeCount*/) {
+        // Everything was allocated in one arena
+        TT_FBX::Arena::release(takes);
     }
 }
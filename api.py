@@ -1,10 +1,10 @@
 import os
 import ctypes
-from tt_fbx.fbx.dataModel import FbxImportContext, AnimationChannels, MultiMeshData, Node
+from tt_fbx.fbx.dataModel import FbxImportContext, AnimationChannels, MultiMeshData, MeshExtractSettings, Node, SubMeshCallback, StaticBatches, SceneGeometry
 
 
-def initialize():
-    dll = ctypes.CDLL(os.path.join(os.path.dirname(os.path.abspath(__file__)), 'fbx', 'x64', 'Release', 'fbx.dll'))
+def initialize(configuration='Release'):
+    dll = ctypes.CDLL(os.path.join(os.path.dirname(os.path.abspath(__file__)), 'fbx', 'x64', configuration, 'fbx.dll'))
 
     dll.importFbx.argtypes = (ctypes.c_char_p, ctypes.c_int, ctypes.c_int, ctypes.c_int, ctypes.c_int)
     dll.importFbx.restype = ctypes.POINTER(FbxImportContext)
@@ -15,15 +15,51 @@ def initialize():
     dll.extractNodes.restype = ctypes.POINTER(Node)
     dll.freeNodes.argtypes = (ctypes.POINTER(Node), ctypes.c_uint32)
     dll.freeNodes.restype = None
+    dll.findNode.argtypes = (ctypes.POINTER(FbxImportContext), ctypes.c_char_p)
+    dll.findNode.restype = ctypes.c_int
 
     dll.extractTakes.argtypes = (ctypes.POINTER(FbxImportContext), ctypes.c_double, ctypes.POINTER(ctypes.c_uint32))
     dll.extractTakes.restype = ctypes.POINTER(AnimationChannels)
     dll.freeTakes.argtypes = (ctypes.POINTER(AnimationChannels), ctypes.c_uint32)
     dll.freeTakes.restype = None
 
-    dll.extractMeshes.argtypes = (ctypes.POINTER(FbxImportContext), ctypes.POINTER(ctypes.c_uint32))
+    dll.extractMeshes.argtypes = (ctypes.POINTER(FbxImportContext), ctypes.POINTER(MeshExtractSettings), ctypes.POINTER(ctypes.c_uint32))
     dll.extractMeshes.restype = ctypes.POINTER(MultiMeshData)
     dll.freeMeshes.argtypes = (ctypes.POINTER(MultiMeshData), ctypes.c_uint32)
     dll.freeMeshes.restype = None
+    dll.extractMeshesStreamed.argtypes = (ctypes.POINTER(FbxImportContext), ctypes.POINTER(MeshExtractSettings), SubMeshCallback, ctypes.c_void_p)
+    dll.extractMeshesStreamed.restype = ctypes.c_bool
+    dll.extractMeshAt.argtypes = (ctypes.POINTER(FbxImportContext), ctypes.c_uint32, ctypes.POINTER(MeshExtractSettings))
+    dll.extractMeshAt.restype = ctypes.POINTER(MultiMeshData)
+    dll.freeExtractedMeshes.argtypes = (ctypes.POINTER(FbxImportContext),)
+    dll.freeExtractedMeshes.restype = None
+    dll.instanceIdenticalMeshes.argtypes = (ctypes.POINTER(FbxImportContext),)
+    dll.instanceIdenticalMeshes.restype = None
+    dll.buildStaticBatches.argtypes = (ctypes.POINTER(FbxImportContext), ctypes.POINTER(MeshExtractSettings))
+    dll.buildStaticBatches.restype = ctypes.POINTER(StaticBatches)
+    dll.freeStaticBatches.argtypes = (ctypes.POINTER(StaticBatches),)
+    dll.freeStaticBatches.restype = None
+    dll.extractSceneGeometry.argtypes = (ctypes.POINTER(FbxImportContext), ctypes.POINTER(MeshExtractSettings), ctypes.c_uint32)
+    dll.extractSceneGeometry.restype = ctypes.POINTER(SceneGeometry)
+    dll.freeSceneGeometry.argtypes = (ctypes.POINTER(SceneGeometry),)
+    dll.freeSceneGeometry.restype = None
+
+    dll.encodeVertexBufferBound.argtypes = (ctypes.c_size_t, ctypes.c_size_t)
+    dll.encodeVertexBufferBound.restype = ctypes.c_size_t
+    dll.encodeVertexBuffer.argtypes = (ctypes.c_void_p, ctypes.c_size_t, ctypes.c_void_p, ctypes.c_size_t, ctypes.c_size_t)
+    dll.encodeVertexBuffer.restype = ctypes.c_size_t
+    dll.decodeVertexBuffer.argtypes = (ctypes.c_void_p, ctypes.c_size_t, ctypes.c_size_t, ctypes.c_void_p, ctypes.c_size_t)
+    dll.decodeVertexBuffer.restype = ctypes.c_bool
+    dll.encodeIndexBufferBound.argtypes = (ctypes.c_size_t,)
+    dll.encodeIndexBufferBound.restype = ctypes.c_size_t
+    dll.encodeIndexBuffer.argtypes = (ctypes.c_void_p, ctypes.c_size_t, ctypes.c_void_p, ctypes.c_size_t)
+    dll.encodeIndexBuffer.restype = ctypes.c_size_t
+    dll.decodeIndexBuffer.argtypes = (ctypes.c_void_p, ctypes.c_size_t, ctypes.c_void_p, ctypes.c_size_t)
+    dll.decodeIndexBuffer.restype = ctypes.c_bool
+
+    # Only exported by builds with TT_FBX_STRESS_TESTS defined
+    if hasattr(dll, 'runLargeMeshStressTest'):
+        dll.runLargeMeshStressTest.argtypes = (ctypes.c_char_p,)
+        dll.runLargeMeshStressTest.restype = ctypes.c_bool
 
     return dll
@@ -0,0 +1,151 @@
+#include <fbxsdk.h>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <xmmintrin.h>
+#define TT_FBX_SSE
+#endif
+
+#include "boundsBuilder.h"
+
+namespace {
+    struct Vec3 {
+        float x = 0.0f;
+        float y = 0.0f;
+        float z = 0.0f;
+    };
+
+    inline Vec3 sub(const Vec3& a, const Vec3& b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+    inline float dot(const Vec3& a, const Vec3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+
+    inline Vec3 readPosition(const uint8_t* data, size_t stride, size_t vertex) {
+        Vec3 result;
+        memcpy(&result, data + vertex * stride, sizeof(Vec3));
+        return result;
+    }
+
+    // Call fn for every position in the spans.
+    template<typename Fn>
+    void forEachPosition(const std::vector<TT_FBX::PositionSpan>& spans, Fn fn) {
+        for (const TT_FBX::PositionSpan& span : spans) {
+            for (size_t i = 0; i < span.count; ++i)
+                fn(readPosition(span.data, span.stride, span.vertices ? span.vertices[i] : i));
+        }
+    }
+
+    // Box of one span. Only the 3 floats of a position are loaded, the next bytes can be past the end of the buffer.
+    void expandBox(const TT_FBX::PositionSpan& span, Vec3& minimum, Vec3& maximum) {
+#ifdef TT_FBX_SSE
+        __m128 lo = _mm_setr_ps(minimum.x, minimum.y, minimum.z, 0.0f);
+        __m128 hi = _mm_setr_ps(maximum.x, maximum.y, maximum.z, 0.0f);
+        for (size_t i = 0; i < span.count; ++i) {
+            const float* position = (const float*)(span.data + (span.vertices ? span.vertices[i] : i) * span.stride);
+            __m128 p = _mm_movelh_ps(_mm_loadl_pi(_mm_setzero_ps(), (const __m64*)position), _mm_load_ss(position + 2));
+            lo = _mm_min_ps(lo, p);
+            hi = _mm_max_ps(hi, p);
+        }
+        float lows[4];
+        float highs[4];
+        _mm_storeu_ps(lows, lo);
+        _mm_storeu_ps(highs, hi);
+        minimum = { lows[0], lows[1], lows[2] };
+        maximum = { highs[0], highs[1], highs[2] };
+#else
+        for (size_t i = 0; i < span.count; ++i) {
+            Vec3 p = readPosition(span.data, span.stride, span.vertices ? span.vertices[i] : i);
+            minimum = { std::min(minimum.x, p.x), std::min(minimum.y, p.y), std::min(minimum.z, p.z) };
+            maximum = { std::max(maximum.x, p.x), std::max(maximum.y, p.y), std::max(maximum.z, p.z) };
+        }
+#endif
+    }
+}
+
+namespace TT_FBX {
+    Bounds computeBounds(const std::vector<PositionSpan>& spans) {
+        Bounds result;
+        size_t count = 0;
+        for (const PositionSpan& span : spans)
+            count += span.count;
+        if (count == 0)
+            return result;
+
+        Vec3 minimum = { FLT_MAX, FLT_MAX, FLT_MAX };
+        Vec3 maximum = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+        for (const PositionSpan& span : spans)
+            expandBox(span, minimum, maximum);
+        result.min[0] = minimum.x;
+        result.min[1] = minimum.y;
+        result.min[2] = minimum.z;
+        result.max[0] = maximum.x;
+        result.max[1] = maximum.y;
+        result.max[2] = maximum.z;
+
+        // Sphere around the center of the box
+        Vec3 boxCenter = { (minimum.x + maximum.x) * 0.5f, (minimum.y + maximum.y) * 0.5f, (minimum.z + maximum.z) * 0.5f };
+        float boxRadiusSquared = 0.0f;
+
+        // Extreme points along the axes and the box diagonals, the pair furthest apart seeds the Ritter sphere
+        const Vec3 directions[7] = { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 }, { 1, 1, 1 }, { 1, 1, -1 }, { 1, -1, 1 }, { 1, -1, -1 } };
+        Vec3 lowest[7];
+        Vec3 highest[7];
+        float lowestDot[7];
+        float highestDot[7];
+        std::fill(lowestDot, lowestDot + 7, FLT_MAX);
+        std::fill(highestDot, highestDot + 7, -FLT_MAX);
+        forEachPosition(spans, [&](const Vec3& p) {
+            Vec3 d = sub(p, boxCenter);
+            boxRadiusSquared = std::max(boxRadiusSquared, dot(d, d));
+            for (int i = 0; i < 7; ++i) {
+                float t = dot(p, directions[i]);
+                if (t < lowestDot[i]) {
+                    lowestDot[i] = t;
+                    lowest[i] = p;
+                }
+                if (t > highestDot[i]) {
+                    highestDot[i] = t;
+                    highest[i] = p;
+                }
+            }
+        });
+
+        int seed = 0;
+        float seedDistance = -1.0f;
+        for (int i = 0; i < 7; ++i) {
+            Vec3 d = sub(highest[i], lowest[i]);
+            if (dot(d, d) > seedDistance) {
+                seedDistance = dot(d, d);
+                seed = i;
+            }
+        }
+        Vec3 center = { (lowest[seed].x + highest[seed].x) * 0.5f, (lowest[seed].y + highest[seed].y) * 0.5f, (lowest[seed].z + highest[seed].z) * 0.5f };
+        float radius = sqrtf(seedDistance) * 0.5f;
+
+        // Grow the sphere just enough to include every point outside of it
+        forEachPosition(spans, [&](const Vec3& p) {
+            Vec3 d = sub(p, center);
+            float distanceSquared = dot(d, d);
+            if (distanceSquared <= radius * radius)
+                return;
+            float distance = sqrtf(distanceSquared);
+            float newRadius = (radius + distance) * 0.5f;
+            float shift = (newRadius - radius) / distance;
+            center = { center.x + d.x * shift, center.y + d.y * shift, center.z + d.z * shift };
+            radius = newRadius;
+        });
+
+        float boxRadius = sqrtf(boxRadiusSquared);
+        if (boxRadius < radius) {
+            center = boxCenter;
+            radius = boxRadius;
+        }
+        result.center[0] = center.x;
+        result.center[1] = center.y;
+        result.center[2] = center.z;
+        // Make up for rounding in the incremental updates
+        result.radius = radius * (1.0f + FLT_EPSILON * 4.0f);
+        return result;
+    }
+}
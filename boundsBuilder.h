@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "meshParser.h"
+
+namespace TT_FBX {
+    // Strided float3 positions to bound, optionally only a subset of them.
+    struct PositionSpan {
+        const uint8_t* data = nullptr;
+        size_t stride = 0;
+        size_t count = 0;
+        // When set, only these count vertices are used, otherwise the first count vertices.
+        const uint32_t* vertices = nullptr;
+    };
+
+    // Compute the box and a tight bounding sphere of all positions in the spans.
+    // The sphere is the smaller of the box-centered sphere and a Ritter sphere seeded from extreme points along 7 directions,
+    // usually within a few percent of the minimal sphere.
+    Bounds computeBounds(const std::vector<PositionSpan>& spans);
+}
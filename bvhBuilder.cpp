@@ -0,0 +1,230 @@
+#include <fbxsdk.h>
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+
+#include "bvhBuilder.h"
+
+namespace {
+    constexpr uint32_t MIN_BIN_COUNT = 2;
+    constexpr uint32_t MAX_BIN_COUNT = 64;
+    // Cost of visiting a node relative to intersecting a triangle.
+    constexpr float TRAVERSAL_COST = 1.0f;
+    // Levels built up front before the remaining subtrees are built in parallel, up to 2^TASK_DEPTH of them.
+    constexpr uint32_t TASK_DEPTH = 5;
+    // Subtrees smaller than this are built by whichever task reaches them, a task of their own isn't worth it.
+    constexpr uint32_t MIN_TASK_TRIANGLES = 16 * 1024;
+
+    struct Aabb {
+        float min[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+        float max[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+        void grow(const float* point) {
+            for (int i = 0; i < 3; ++i) {
+                min[i] = std::min(min[i], point[i]);
+                max[i] = std::max(max[i], point[i]);
+            }
+        }
+
+        void grow(const Aabb& other) {
+            for (int i = 0; i < 3; ++i) {
+                min[i] = std::min(min[i], other.min[i]);
+                max[i] = std::max(max[i], other.max[i]);
+            }
+        }
+
+        // Half the surface area, the factor 2 cancels out in every comparison.
+        float area() const {
+            float x = max[0] - min[0];
+            float y = max[1] - min[1];
+            float z = max[2] - min[2];
+            return x < 0.0f ? 0.0f : x * y + y * z + z * x;
+        }
+    };
+
+    struct Bin {
+        Aabb bounds;
+        uint32_t count = 0;
+    };
+
+    // A subtree whose node slot exists but that still has to be built.
+    struct Task {
+        uint32_t node = 0;
+        uint32_t first = 0;
+        uint32_t count = 0;
+    };
+
+    class Builder {
+    public:
+        Builder(const std::vector<Aabb>& triangleBounds, const std::vector<float>& centroids, std::vector<uint32_t>& triangles, uint32_t maxLeafTriangles, uint32_t binCount)
+            : triangleBounds(triangleBounds), centroids(centroids), triangles(triangles), maxLeafTriangles(maxLeafTriangles), binCount(binCount) {}
+
+        // Build the subtree of nodes[node] over triangles [first, first + count). With tasks, subtrees at TASK_DEPTH are deferred to it instead.
+        void build(std::vector<BvhNode>& nodes, uint32_t node, uint32_t first, uint32_t count, uint32_t depth, std::vector<Task>* tasks) const {
+            if (tasks && depth == TASK_DEPTH && count >= MIN_TASK_TRIANGLES) {
+                tasks->push_back({ node, first, count });
+                return;
+            }
+
+            Aabb bounds;
+            Aabb centroidBounds;
+            for (uint32_t i = first; i < first + count; ++i) {
+                bounds.grow(triangleBounds[triangles[i]]);
+                centroidBounds.grow(&centroids[triangles[i] * 3]);
+            }
+            memcpy(nodes[node].min, bounds.min, sizeof(bounds.min));
+            memcpy(nodes[node].max, bounds.max, sizeof(bounds.max));
+            nodes[node].leftOrFirst = first;
+            nodes[node].triangleCount = count;
+            if (count <= 1)
+                return;
+
+            // Costs are scaled by the parent area, so flat nodes with an area of 0 compare fine
+            int axis = -1;
+            uint32_t plane = 0;
+            float splitCost = FLT_MAX;
+            findSplit(first, count, centroidBounds, axis, plane, splitCost);
+            splitCost += TRAVERSAL_COST * bounds.area();
+            if (count <= maxLeafTriangles && (axis == -1 || (float)count * bounds.area() <= splitCost))
+                return;
+
+            uint32_t middle = first;
+            if (axis != -1) {
+                float scale = binCount / (centroidBounds.max[axis] - centroidBounds.min[axis]);
+                middle = (uint32_t)(std::partition(triangles.begin() + first, triangles.begin() + first + count, [&](uint32_t triangle) {
+                    return binIndex(centroids[triangle * 3 + axis], centroidBounds.min[axis], scale) < plane;
+                }) - triangles.begin());
+            }
+            // Identical centroids can't be binned apart, split them in the middle to honor maxLeafTriangles
+            if (middle == first || middle == first + count) {
+                int longest = 0;
+                for (int i = 1; i < 3; ++i) {
+                    if (centroidBounds.max[i] - centroidBounds.min[i] > centroidBounds.max[longest] - centroidBounds.min[longest])
+                        longest = i;
+                }
+                middle = first + count / 2;
+                std::nth_element(triangles.begin() + first, triangles.begin() + middle, triangles.begin() + first + count, [&](uint32_t a, uint32_t b) {
+                    return centroids[a * 3 + longest] < centroids[b * 3 + longest];
+                });
+            }
+
+            uint32_t left = (uint32_t)nodes.size();
+            nodes.resize(nodes.size() + 2);
+            nodes[node].leftOrFirst = left;
+            nodes[node].triangleCount = 0;
+            build(nodes, left, first, middle - first, depth + 1, tasks);
+            build(nodes, left + 1, middle, first + count - middle, depth + 1, tasks);
+        }
+
+    private:
+        const std::vector<Aabb>& triangleBounds;
+        const std::vector<float>& centroids;
+        std::vector<uint32_t>& triangles;
+        uint32_t maxLeafTriangles;
+        uint32_t binCount;
+
+        inline uint32_t binIndex(float centroid, float minimum, float scale) const {
+            return std::min(binCount - 1, (uint32_t)((centroid - minimum) * scale));
+        }
+
+        // The cheapest split over all axes, triangles with a bin below plane go left. Leaves axis at -1 if nothing can be split.
+        void findSplit(uint32_t first, uint32_t count, const Aabb& centroidBounds, int& bestAxis, uint32_t& bestPlane, float& bestCost) const {
+            Bin bins[MAX_BIN_COUNT];
+            float rightAreas[MAX_BIN_COUNT];
+            uint32_t rightCounts[MAX_BIN_COUNT];
+            for (int axis = 0; axis < 3; ++axis) {
+                float extent = centroidBounds.max[axis] - centroidBounds.min[axis];
+                if (extent <= 0.0f)
+                    continue;
+                float scale = binCount / extent;
+                for (uint32_t b = 0; b < binCount; ++b)
+                    bins[b] = Bin();
+                for (uint32_t i = first; i < first + count; ++i) {
+                    uint32_t triangle = triangles[i];
+                    Bin& bin = bins[binIndex(centroids[triangle * 3 + axis], centroidBounds.min[axis], scale)];
+                    bin.bounds.grow(triangleBounds[triangle]);
+                    bin.count++;
+                }
+
+                // Sweep from the right to get the cost of everything above every plane, then from the left to combine
+                Aabb right;
+                uint32_t rightCount = 0;
+                for (uint32_t b = binCount - 1; b > 0; --b) {
+                    right.grow(bins[b].bounds);
+                    rightCount += bins[b].count;
+                    rightAreas[b] = right.area();
+                    rightCounts[b] = rightCount;
+                }
+                Aabb left;
+                uint32_t leftCount = 0;
+                for (uint32_t b = 1; b < binCount; ++b) {
+                    left.grow(bins[b - 1].bounds);
+                    leftCount += bins[b - 1].count;
+                    if (leftCount == 0 || rightCounts[b] == 0)
+                        continue;
+                    float cost = left.area() * leftCount + rightAreas[b] * rightCounts[b];
+                    if (cost < bestCost) {
+                        bestCost = cost;
+                        bestAxis = axis;
+                        bestPlane = b;
+                    }
+                }
+            }
+        }
+    };
+}
+
+namespace TT_FBX {
+    BvhBuffers buildBvh(const std::vector<uint32_t>& indices, const uint8_t* vertexData, size_t stride, uint32_t maxLeafTriangles, uint32_t binCount) {
+        BvhBuffers result;
+        uint32_t triangleCount = (uint32_t)(indices.size() / 3);
+        if (triangleCount == 0)
+            return result;
+
+        std::vector<Aabb> triangleBounds(triangleCount);
+        std::vector<float> centroids(triangleCount * 3);
+        for (uint32_t t = 0; t < triangleCount; ++t) {
+            for (int corner = 0; corner < 3; ++corner) {
+                float p[3];
+                memcpy(p, vertexData + indices[t * 3 + corner] * stride, sizeof(p));
+                triangleBounds[t].grow(p);
+            }
+            for (int i = 0; i < 3; ++i)
+                centroids[t * 3 + i] = (triangleBounds[t].min[i] + triangleBounds[t].max[i]) * 0.5f;
+        }
+
+        result.triangles.resize(triangleCount);
+        for (uint32_t t = 0; t < triangleCount; ++t)
+            result.triangles[t] = t;
+
+        binCount = std::max(MIN_BIN_COUNT, std::min(MAX_BIN_COUNT, binCount));
+        Builder builder(triangleBounds, centroids, result.triangles, std::max(1u, maxLeafTriangles), binCount);
+        result.nodes.resize(1);
+        if (triangleCount < 2 * MIN_TASK_TRIANGLES) {
+            builder.build(result.nodes, 0, 0, triangleCount, 0, nullptr);
+            return result;
+        }
+
+        // The top of the tree is built here, the subtrees below it in parallel. Their triangle ranges don't overlap.
+        std::vector<Task> tasks;
+        builder.build(result.nodes, 0, 0, triangleCount, 0, &tasks);
+        std::vector<std::vector<BvhNode>> subtrees(tasks.size());
+        TT_FBX::parallelFor(tasks.size(), [&](size_t i) {
+            subtrees[i].resize(1);
+            builder.build(subtrees[i], 0, tasks[i].first, tasks[i].count, 0, nullptr);
+        });
+
+        // Subtree roots go in the slots their parents reserved, the rest is appended and renumbered
+        for (size_t i = 0; i < tasks.size(); ++i) {
+            std::vector<BvhNode>& subtree = subtrees[i];
+            uint32_t base = (uint32_t)result.nodes.size() - 1;
+            for (BvhNode& node : subtree) {
+                if (node.triangleCount == 0)
+                    node.leftOrFirst += base;
+            }
+            result.nodes[tasks[i].node] = subtree[0];
+            result.nodes.insert(result.nodes.end(), subtree.begin() + 1, subtree.end());
+        }
+        return result;
+    }
+}
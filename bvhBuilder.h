@@ -0,0 +1,18 @@
+#pragma once
+
+#include <vector>
+
+#include "meshParser.h"
+
+namespace TT_FBX {
+    // BVH of a single submesh, see MeshData::bvhNodes.
+    struct BvhBuffers {
+        std::vector<BvhNode> nodes;
+        std::vector<uint32_t> triangles;
+    };
+
+    // Build a BVH over a triangle list with the surface area heuristic, evaluated at binCount planes per axis.
+    // Nodes are stored depth first with siblings next to each other. Large meshes build their subtrees in parallel.
+    // The vertex data must start with a float3 position.
+    BvhBuffers buildBvh(const std::vector<uint32_t>& indices, const uint8_t* vertexData, size_t stride, uint32_t maxLeafTriangles, uint32_t binCount);
+}
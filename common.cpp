@@ -1,3 +1,11 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 #include <fbxsdk.h>
@@ -5,6 +13,84 @@
 #include "common.h"
 #include "fbxLoader.h"
 
+namespace {
+    // One parallelFor call, its indices are handed out to whichever threads work on it.
+    struct Job {
+        const std::function<void(size_t)>* fn = nullptr;
+        size_t count = 0;
+        std::atomic<size_t> next = 0;
+        std::atomic<size_t> done = 0;
+    };
+
+    // Worker threads that live as long as the process, so parallelFor doesn't start threads on every call.
+    // Nested calls queue their job like any other, idle workers pick it up while the caller works on it as well.
+    class ThreadPool {
+    public:
+        ThreadPool(size_t workerCount) {
+            for (size_t i = 0; i < workerCount; ++i)
+                std::thread([this]() { work(); }).detach();
+        }
+
+        void run(size_t count, const std::function<void(size_t)>& fn) {
+            std::shared_ptr<Job> job = std::make_shared<Job>();
+            job->fn = &fn;
+            job->count = count;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                jobs.push_back(job);
+            }
+            wakeup.notify_all();
+
+            // The caller only works on its own job, the indices other threads took are waited for.
+            // That keeps nesting off the stack of threads that wait, and every job makes progress through its caller.
+            execute(*job);
+            std::unique_lock<std::mutex> lock(mutex);
+            finished.wait(lock, [&]() { return job->done == job->count; });
+            auto it = std::find(jobs.begin(), jobs.end(), job);
+            if (it != jobs.end())
+                jobs.erase(it);
+        }
+
+    private:
+        std::mutex mutex;
+        std::condition_variable wakeup;
+        std::condition_variable finished;
+        // Jobs that may have indices left, in the order they were started.
+        std::deque<std::shared_ptr<Job>> jobs;
+
+        void execute(Job& job) {
+            for (size_t i = job.next++; i < job.count; i = job.next++) {
+                (*job.fn)(i);
+                if (++job.done == job.count) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    finished.notify_all();
+                }
+            }
+        }
+
+        void work() {
+            std::unique_lock<std::mutex> lock(mutex);
+            for (;;) {
+                wakeup.wait(lock, [&]() { return !jobs.empty(); });
+                std::shared_ptr<Job> job = jobs.front();
+                if (job->next >= job->count) {
+                    jobs.pop_front();
+                    continue;
+                }
+                lock.unlock();
+                execute(*job);
+                lock.lock();
+            }
+        }
+    };
+
+    // Never destroyed, joining threads while the DLL unloads can deadlock.
+    ThreadPool& getThreadPool() {
+        static ThreadPool* pool = new ThreadPool(std::thread::hardware_concurrency() - 1);
+        return *pool;
+    }
+}
+
 namespace TT_FBX {
     FbxAMatrix matrixFromEuler(FbxEuler::EOrder order, FbxVector4 euler) {
         FbxAMatrix result;
@@ -19,4 +105,144 @@ namespace TT_FBX {
         memcpy(r.buffer, text, r.length);
         return r;
     }
+
+    Arena::~Arena() {
+        freeBlocks(first);
+    }
+
+    void* Arena::allocateBytes(size_t size) {
+        // Round up so every allocation stays aligned
+        size = (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+        if (current && current->capacity - current->used >= size) {
+            void* result = (uint8_t*)current + HEADER_SIZE + current->used;
+            current->used += size;
+            return result;
+        }
+
+        // Blocks grow as the arena grows, allocations that don't fit get a block of their own
+        size_t capacity = std::max(size, nextBlockSize);
+        nextBlockSize = std::min(nextBlockSize * 2, MAX_BLOCK_SIZE);
+        Block* block = new (::operator new(HEADER_SIZE + capacity)) Block;
+        block->capacity = capacity;
+        block->used = size;
+
+        // The first block must stay at the head of the chain, it is the one release() finds
+        if (!first) {
+            first = block;
+        } else {
+            block->next = first->next;
+            first->next = block;
+        }
+
+        // Keep bumping in whichever block has more space left
+        if (!current || capacity - size > current->capacity - current->used)
+            current = block;
+        return (uint8_t*)block + HEADER_SIZE;
+    }
+
+    void Arena::registerCleanup(Cleanup* cleanup) {
+        cleanup->next = first->cleanups;
+        first->cleanups = cleanup;
+    }
+
+    String Arena::makeString(const char* text, size_t length) {
+        String r;
+        r.length = (uint32_t)length;
+        r.buffer = allocate<char>(length);
+        memcpy(r.buffer, text, length);
+        return r;
+    }
+
+    String Arena::makeString(const char* text) {
+        return makeString(text, strlen(text));
+    }
+
+    String* Arena::makeStringList(const std::vector<std::string>& list) {
+        String* result = allocate<String>(list.size());
+        int cursor = 0;
+        for (const std::string& text : list)
+            result[cursor++] = makeString(text.data(), text.size());
+        return result;
+    }
+
+    void Arena::clear() {
+        freeBlocks(first);
+        first = nullptr;
+        current = nullptr;
+        nextBlockSize = MIN_BLOCK_SIZE;
+    }
+
+    void Arena::detach() {
+        first = nullptr;
+        current = nullptr;
+    }
+
+    void Arena::release(const void* firstAllocation) {
+        if (firstAllocation)
+            freeBlocks((Block*)((uint8_t*)firstAllocation - HEADER_SIZE));
+    }
+
+    void Arena::freeBlocks(Block* block) {
+        if (!block)
+            return;
+        for (Cleanup* cleanup = block->cleanups; cleanup;) {
+            Cleanup* next = cleanup->next;
+            cleanup->destroy(cleanup);
+            cleanup = next;
+        }
+        while (block) {
+            Block* next = block->next;
+            ::operator delete(block);
+            block = next;
+        }
+    }
+
+    namespace {
+        constexpr uint64_t PRIME_1 = 0x9E3779B185EBCA87ull;
+        constexpr uint64_t PRIME_2 = 0xC2B2AE3D27D4EB4Full;
+
+        inline uint64_t rotateLeft(uint64_t value, int bits) {
+            return (value << bits) | (value >> (64 - bits));
+        }
+    }
+
+    void ContentHash::mix(uint64_t word) {
+        state ^= rotateLeft(word * PRIME_2, 31) * PRIME_1;
+        state = rotateLeft(state, 27) * PRIME_1 + 0x85EBCA77C2B2AE63ull;
+    }
+
+    void ContentHash::addBytes(const void* data, size_t size) {
+        mix(size);
+        const uint8_t* bytes = (const uint8_t*)data;
+        for (; size >= sizeof(uint64_t); size -= sizeof(uint64_t), bytes += sizeof(uint64_t)) {
+            uint64_t word;
+            memcpy(&word, bytes, sizeof(word));
+            mix(word);
+        }
+        if (size > 0) {
+            uint64_t word = 0;
+            memcpy(&word, bytes, size);
+            mix(word);
+        }
+    }
+
+    uint64_t ContentHash::value() const {
+        // Final avalanche so every input bit affects every output bit
+        uint64_t result = state;
+        result ^= result >> 33;
+        result *= PRIME_2;
+        result ^= result >> 29;
+        result *= 0x165667B19E3779F9ull;
+        result ^= result >> 32;
+        return result;
+    }
+
+    void parallelFor(size_t count, const std::function<void(size_t)>& fn) {
+        if (count <= 1 || std::thread::hardware_concurrency() <= 1) {
+            for (size_t i = 0; i < count; ++i)
+                fn(i);
+            return;
+        }
+        getThreadPool().run(count, fn);
+    }
 }
@@ -1,6 +1,13 @@
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
+#include <algorithm>
+#include <functional>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 #include <fbxsdk/scene/geometry/fbxnodeattribute.h>
@@ -14,17 +21,137 @@ extern "C" {
 }
 
 namespace TT_FBX {
-    // Utility to convert a vector to a C-array
-    template<typename T>
-    T* flattenList(const std::vector<T>& list) {
-        T* result = new T[list.size()];
-        int cursor = 0;
-        for (const T& element : list)
-            result[cursor++] = element;
-        return result;
-    }
+    // Bump allocator that owns an entire result graph handed out through the C API,
+    // so the matching free function releases it in one go instead of mirroring every allocation.
+    // The first allocation must be the root array returned to the caller, the arena bookkeeping
+    // sits right in front of it so Arena::release can find everything from that pointer alone.
+    class Arena {
+    public:
+        Arena() = default;
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+        // Frees everything, unless ownership was handed to the caller with detach().
+        ~Arena();
+
+        // Allocate count value-initialized elements. Destructors never run, so only plain data is allowed.
+        template<typename T>
+        T* allocate(size_t count) {
+            static_assert(std::is_trivially_destructible<T>::value, "Arena memory is released without running destructors");
+            static_assert(alignof(T) <= ALIGNMENT, "Arena allocations are only aligned to max_align_t");
+            T* result = (T*)allocateBytes(count * sizeof(T));
+            for (size_t i = 0; i < count; ++i)
+                new (result + i) T();
+            return result;
+        }
+
+        // Utility to convert a vector to a C-array
+        template<typename T>
+        T* flattenList(const std::vector<T>& list) {
+            T* result = allocate<T>(list.size());
+            std::copy(list.begin(), list.end(), result);
+            return result;
+        }
+
+        // Take over a vector without copying, its buffer lives until the arena is released. Empty vectors give nullptr
+        // and small ones are copied into the arena instead, so neither costs a heap block and a cleanup.
+        // Never use this for the first allocation, release() needs that to be plain arena memory.
+        template<typename T>
+        T* adopt(std::vector<T>&& list) {
+            if (list.empty())
+                return nullptr;
+            if (list.size() * sizeof(T) <= MAX_COPIED_SIZE)
+                return flattenList(list);
+            return emplace<std::vector<T>>(std::move(list))->data();
+        }
+
+        // Construct an object that is destroyed when the arena is released, for resources the result depends on.
+        // Never use this for the first allocation either.
+        template<typename T, typename... Args>
+        T* emplace(Args&&... args) {
+            Owned<T>* holder = new (allocateBytes(sizeof(Owned<T>))) Owned<T>(std::forward<Args>(args)...);
+            registerCleanup(holder);
+            return &holder->object;
+        }
+
+        String makeString(const char* text, size_t length);
+        String makeString(const char* text);
+        String* makeStringList(const std::vector<std::string>& list);
+
+        // Give up ownership, the caller must pass the first allocation to Arena::release when done.
+        void detach();
+
+        // Free everything and start over, the next allocation is the first one again.
+        void clear();
+
+        // Free an arena given the first allocation that was made in it.
+        static void release(const void* firstAllocation);
+
+    private:
+        static constexpr size_t ALIGNMENT = alignof(max_align_t);
+        static constexpr size_t MIN_BLOCK_SIZE = 64 * 1024;
+        static constexpr size_t MAX_BLOCK_SIZE = 16 * 1024 * 1024;
+        // Largest vector adopt copies into the arena.
+        static constexpr size_t MAX_COPIED_SIZE = 1024;
+
+        // Destroys an owned object when the arena is released
+        struct Cleanup {
+            Cleanup* next = nullptr;
+            void (*destroy)(Cleanup*) = nullptr;
+        };
+
+        template<typename T>
+        struct Owned : Cleanup {
+            T object;
+            template<typename... Args>
+            Owned(Args&&... args) : object(std::forward<Args>(args)...) {
+                destroy = [](Cleanup* cleanup) { static_cast<Owned*>(cleanup)->~Owned(); };
+            }
+        };
+
+        struct Block {
+            Block* next = nullptr;
+            size_t capacity = 0;
+            size_t used = 0;
+            // Only used in the first block
+            Cleanup* cleanups = nullptr;
+        };
+        static constexpr size_t HEADER_SIZE = (sizeof(Block) + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+
+        Block* first = nullptr;
+        Block* current = nullptr;
+        size_t nextBlockSize = MIN_BLOCK_SIZE;
+
+        void* allocateBytes(size_t size);
+        void registerCleanup(Cleanup* cleanup);
+        static void freeBlocks(Block* block);
+    };
 
     FbxAMatrix matrixFromEuler(FbxEuler::EOrder order, FbxVector4 euler);
 
     String makeString(const char* text);
+
+    // Streaming 64 bit hash for content addressing. The result only depends on the bytes and the order they are added in,
+    // so it is stable across runs and machines (of the same endianness) and can be used as a key on disk.
+    class ContentHash {
+    public:
+        // The size is part of the hash, so adding "ab" + "c" differs from "a" + "bc".
+        void addBytes(const void* data, size_t size);
+
+        template<typename T>
+        void add(const T& data) {
+            static_assert(std::is_trivially_copyable<T>::value, "Only plain values can be hashed by their bytes");
+            addBytes(&data, sizeof(T));
+        }
+
+        uint64_t value() const;
+
+    private:
+        uint64_t state = 0x27D4EB2F165667C5ull;
+        void mix(uint64_t word);
+    };
+
+    // Call fn(i) for every i in [0, count) spread over all hardware threads.
+    // Work is handed out one index at a time, so uneven workloads balance out.
+    // Calls from inside fn share the same worker threads, so nested loops still use every thread that is idle.
+    void parallelFor(size_t count, const std::function<void(size_t)>& fn);
 }
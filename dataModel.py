@@ -46,11 +46,40 @@ class ScenePatchFlags(IntEnum):
     ConvertNurbsToPolygons = 1 << 0
     Triangulate = 1 << 1
     RemoveBadPolygons = 1 << 2
+    # Not supported, use buildStaticBatches
     CollapseMeshes = 1 << 3
     SplitMeshesPerMaterial = 1 << 4
     CenterScene = 1 << 5
 
 
+class MeshExtractFlags(IntEnum):
+    OptimizeVertexCache = 1 << 0
+    OptimizeOverdraw = 1 << 1
+    OptimizeVertexFetch = 1 << 2
+    BuildMeshlets = 1 << 3
+    SharedVertexBuffer = 1 << 4
+    GenerateTangents = 1 << 5
+    GenerateNormals = 1 << 6
+    QuantizeMorphTargets = 1 << 7
+    WeldVertices = 1 << 8
+    BuildBvh = 1 << 9
+
+
+class SemanticMask(IntEnum):
+    Normal = 1 << 0
+    Tangent = 1 << 1
+    Binormal = 1 << 2
+    UV = 1 << 3
+    Color = 1 << 4
+    All = Normal | Tangent | Binormal | UV | Color
+
+
+class VertexStreamMode(IntEnum):
+    Interleaved = 0
+    PerAttribute = 1
+    Grouped = 2
+
+
 class ChannelIdentifier(IntEnum):
     Invalid = 0
     TranslateX = 1
@@ -110,16 +139,109 @@ class VertexAttribute(ctypes.Structure):
         ("semantic", ctypes.c_uint8),
         ("numElements", ctypes.c_uint8),
         ("elementType", ctypes.c_uint32),
+        ("stream", ctypes.c_uint8),
+        ("offset", ctypes.c_uint32),
+        ("stride", ctypes.c_uint32),
+    ]
+
+
+class MeshStatistics(ctypes.Structure):
+    _fields_ = [
+        ("unusedVerticesRemoved", ctypes.c_uint32),
+        ("overfetchBefore", ctypes.c_float),
+        ("overfetchAfter", ctypes.c_float),
+        ("verticesWelded", ctypes.c_uint32),
+    ]
+
+
+class Bounds(ctypes.Structure):
+    _fields_ = [
+        ("min", ctypes.c_float * 3),
+        ("max", ctypes.c_float * 3),
+        ("center", ctypes.c_float * 3),
+        ("radius", ctypes.c_float),
+    ]
+
+
+class Meshlet(ctypes.Structure):
+    _fields_ = [
+        ("vertexOffset", ctypes.c_uint32),
+        ("triangleOffset", ctypes.c_uint32),
+        ("vertexCount", ctypes.c_uint32),
+        ("triangleCount", ctypes.c_uint32),
+        ("center", ctypes.c_float * 3),
+        ("radius", ctypes.c_float),
+        ("coneApex", ctypes.c_float * 3),
+        ("coneAxis", ctypes.c_float * 3),
+        ("coneCutoff", ctypes.c_float),
+    ]
+
+
+class BvhNode(ctypes.Structure):
+    _fields_ = [
+        ("min", ctypes.c_float * 3),
+        ("leftOrFirst", ctypes.c_uint32),
+        ("max", ctypes.c_float * 3),
+        ("triangleCount", ctypes.c_uint32),
+    ]
+
+
+MAX_LOD_COUNT = 8
+SEMANTIC_COUNT = 256
+
+
+class MeshLod(ctypes.Structure):
+    _fields_ = [
+        ("firstIndex", ctypes.c_uint32),
+        ("indexCount", ctypes.c_uint32),
+        ("error", ctypes.c_float),
+    ]
+
+
+class MorphTarget(ctypes.Structure):
+    _fields_ = [
+        ("deltaCount", ctypes.c_uint32),
+        ("vertices", ctypes.POINTER(ctypes.c_uint32)),
+        ("positionDeltas", ctypes.POINTER(ctypes.c_float)),
+        ("normalDeltas", ctypes.POINTER(ctypes.c_float)),
+        ("quantizedPositionDeltas", ctypes.POINTER(ctypes.c_int16)),
+        ("quantizedNormalDeltas", ctypes.POINTER(ctypes.c_int16)),
+        ("positionScale", ctypes.c_float),
+        ("normalScale", ctypes.c_float),
     ]
 
 
 class MeshData(ctypes.Structure):
     _fields_ = [
         ("materialId", ctypes.c_uint32),
-        ("vertexDataSizeInBytes", ctypes.c_uint32),
-        ("indexDataSizeInBytes", ctypes.c_uint32),
+        ("firstIndex", ctypes.c_uint32),
+        ("indexCount", ctypes.c_uint32),
+        ("baseVertex", ctypes.c_uint32),
+        ("vertexDataSizeInBytes", ctypes.c_uint64),
+        ("indexDataSizeInBytes", ctypes.c_uint64),
         ("vertexDataBlob", ctypes.c_void_p),
         ("indexDataBlob", ctypes.c_void_p),
+        ("vertexCount", ctypes.c_uint32),
+        ("streamOffsets", ctypes.POINTER(ctypes.c_uint64)),
+        ("statistics", MeshStatistics),
+        ("meshletCount", ctypes.c_uint32),
+        ("meshlets", ctypes.POINTER(Meshlet)),
+        ("meshletVertexCount", ctypes.c_uint32),
+        ("meshletVertices", ctypes.POINTER(ctypes.c_uint32)),
+        ("meshletTriangleCount", ctypes.c_uint32),
+        ("meshletTriangles", ctypes.POINTER(ctypes.c_uint32)),
+        ("lodCount", ctypes.c_uint32),
+        ("lods", ctypes.POINTER(MeshLod)),
+        ("lodIndexCount", ctypes.c_uint32),
+        ("lodIndices", ctypes.POINTER(ctypes.c_uint32)),
+        ("bounds", Bounds),
+        ("morphTargetCount", ctypes.c_uint32),
+        ("morphTargets", ctypes.POINTER(MorphTarget)),
+        ("contentHash", ctypes.c_uint64),
+        ("bvhNodeCount", ctypes.c_uint32),
+        ("bvhNodes", ctypes.POINTER(BvhNode)),
+        ("bvhTriangleCount", ctypes.c_uint32),
+        ("bvhTriangles", ctypes.POINTER(ctypes.c_uint32)),
     ]
 
 
@@ -139,9 +261,161 @@ class MultiMeshData(ctypes.Structure):
         ("meshes", ctypes.POINTER(MeshData)),
         ("jointCount", ctypes.c_uint32),
         ("jointIds", ctypes.POINTER(ctypes.c_uint32)),
+        ("streamCount", ctypes.c_uint32),
+        ("sharedVertexCount", ctypes.c_uint32),
+        ("sharedVertexDataSizeInBytes", ctypes.c_uint64),
+        ("sharedVertexDataBlob", ctypes.c_void_p),
+        ("sharedStreamOffsets", ctypes.POINTER(ctypes.c_uint64)),
+        ("sharedIndexDataSizeInBytes", ctypes.c_uint64),
+        ("sharedIndexDataBlob", ctypes.c_void_p),
+        ("bounds", Bounds),
+        ("jointBounds", ctypes.POINTER(Bounds)),
+        ("morphTargetNameCount", ctypes.c_uint32),
+        ("morphTargetNames", ctypes.POINTER(String)),
+        ("sharedMorphTargets", ctypes.POINTER(MorphTarget)),
+        ("contentHash", ctypes.c_uint64),
+    ]
+
+
+class BatchRange(ctypes.Structure):
+    _fields_ = [
+        ("nodeIndex", ctypes.c_int),
+        ("firstIndex", ctypes.c_uint32),
+        ("indexCount", ctypes.c_uint32),
+        ("firstVertex", ctypes.c_uint32),
+        ("vertexCount", ctypes.c_uint32),
+        ("bounds", Bounds),
     ]
 
 
+class StaticBatch(ctypes.Structure):
+    _fields_ = [
+        ("materialId", ctypes.c_uint32),
+        ("attributeCount", ctypes.c_uint32),
+        ("attributeLayout", ctypes.POINTER(VertexAttribute)),
+        ("vertexCount", ctypes.c_uint32),
+        ("vertexDataSizeInBytes", ctypes.c_uint64),
+        ("vertexDataBlob", ctypes.c_void_p),
+        ("indexCount", ctypes.c_uint32),
+        ("indexDataSizeInBytes", ctypes.c_uint64),
+        ("indexDataBlob", ctypes.c_void_p),
+        ("rangeCount", ctypes.c_uint32),
+        ("ranges", ctypes.POINTER(BatchRange)),
+        ("bounds", Bounds),
+    ]
+
+
+class StaticBatches(ctypes.Structure):
+    _fields_ = [
+        ("materialNameCount", ctypes.c_uint32),
+        ("materialNames", ctypes.POINTER(String)),
+        ("batchCount", ctypes.c_uint32),
+        ("batches", ctypes.POINTER(StaticBatch)),
+    ]
+
+
+class SceneLayout(ctypes.Structure):
+    _fields_ = [
+        ("attributeCount", ctypes.c_uint32),
+        ("attributeLayout", ctypes.POINTER(VertexAttribute)),
+    ]
+
+
+class SceneDraw(ctypes.Structure):
+    _fields_ = [
+        ("meshIndex", ctypes.c_uint32),
+        ("subMeshIndex", ctypes.c_uint32),
+        ("materialId", ctypes.c_uint32),
+        ("layoutId", ctypes.c_uint32),
+        ("stride", ctypes.c_uint32),
+        ("page", ctypes.c_uint32),
+        ("firstIndex", ctypes.c_uint32),
+        ("indexCount", ctypes.c_uint32),
+        ("baseVertex", ctypes.c_uint32),
+        ("vertexCount", ctypes.c_uint32),
+        ("vertexByteOffset", ctypes.c_uint64),
+        ("bounds", Bounds),
+    ]
+
+
+class SceneGeometryPage(ctypes.Structure):
+    _fields_ = [
+        ("vertexDataSizeInBytes", ctypes.c_uint64),
+        ("vertexDataBlob", ctypes.c_void_p),
+        ("indexDataSizeInBytes", ctypes.c_uint64),
+        ("indexDataBlob", ctypes.c_void_p),
+    ]
+
+
+class SceneGeometry(ctypes.Structure):
+    _fields_ = [
+        ("materialNameCount", ctypes.c_uint32),
+        ("materialNames", ctypes.POINTER(String)),
+        ("layoutCount", ctypes.c_uint32),
+        ("layouts", ctypes.POINTER(SceneLayout)),
+        ("drawCount", ctypes.c_uint32),
+        ("draws", ctypes.POINTER(SceneDraw)),
+        ("pageCount", ctypes.c_uint32),
+        ("pages", ctypes.POINTER(SceneGeometryPage)),
+    ]
+
+
+# Arguments: mesh, meshIndex, subMeshIndex, userData. The mesh is only valid during the call.
+SubMeshCallback = ctypes.CFUNCTYPE(ctypes.c_bool, ctypes.POINTER(MultiMeshData), ctypes.c_uint32, ctypes.c_uint32, ctypes.c_void_p)
+
+
+class MeshExtractSettings(ctypes.Structure):
+    _fields_ = [
+        ("flags", ctypes.c_uint32),
+        ("overdrawThreshold", ctypes.c_float),
+        ("maxMeshletVertices", ctypes.c_uint32),
+        ("maxMeshletTriangles", ctypes.c_uint32),
+        ("lodCount", ctypes.c_uint32),
+        ("lodTargetRatios", ctypes.c_float * MAX_LOD_COUNT),
+        ("lodTargetErrors", ctypes.c_float * MAX_LOD_COUNT),
+        ("normalCreaseAngle", ctypes.c_float),
+        ("streamMode", ctypes.c_uint32),
+        ("semanticStreams", ctypes.c_uint8 * SEMANTIC_COUNT),
+        ("weldPositionEpsilon", ctypes.c_float),
+        ("weldNormalAngle", ctypes.c_float),
+        ("weldUvEpsilon", ctypes.c_float),
+        ("memoryBudget", ctypes.c_uint64),
+        ("spillDirectory", ctypes.c_char_p),
+        ("semanticMask", ctypes.c_uint32),
+        ("maxNormalLayers", ctypes.c_uint32),
+        ("maxTangentLayers", ctypes.c_uint32),
+        ("maxBinormalLayers", ctypes.c_uint32),
+        ("maxUvLayers", ctypes.c_uint32),
+        ("maxColorLayers", ctypes.c_uint32),
+        ("maxBvhLeafTriangles", ctypes.c_uint32),
+        ("bvhBinCount", ctypes.c_uint32),
+    ]
+
+    def __init__(self, **kwargs):
+        # ctypes zero-initializes everything, mirror the C++ default member initializers instead.
+        defaults = dict(
+            overdrawThreshold=1.05,
+            maxMeshletVertices=64,
+            maxMeshletTriangles=124,
+            lodTargetRatios=tuple(0.5 ** (i + 1) for i in range(MAX_LOD_COUNT)),
+            lodTargetErrors=(1.0,) * MAX_LOD_COUNT,
+            normalCreaseAngle=60.0,
+            weldPositionEpsilon=1e-5,
+            weldNormalAngle=0.5,
+            weldUvEpsilon=1e-5,
+            semanticMask=SemanticMask.All,
+            maxNormalLayers=8,
+            maxTangentLayers=8,
+            maxBinormalLayers=8,
+            maxUvLayers=8,
+            maxColorLayers=255,
+            maxBvhLeafTriangles=4,
+            bvhBinCount=16,
+        )
+        defaults.update(kwargs)
+        super().__init__(**defaults)
+
+
 class FbxImportContext(ctypes.Structure):
     _fields_ = [
         # These void pointers are internal FBX importer state.
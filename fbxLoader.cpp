@@ -1,3 +1,4 @@
+#include <map>
 #include <vector>
 
 #include <fbxsdk.h>
@@ -218,11 +219,6 @@ namespace {
         if ((int)flags & (int)ScenePatchFlags::RemoveBadPolygons)
             lGeomConverter.RemoveBadPolygonsFromMeshes(context->scene);
 
-        if ((int)flags & (int)ScenePatchFlags::CollapseMeshes) {
-            // TODO: This requires a list of meshes to merge, we must list all meshes manually first
-            // lGeomConverter.MergeMeshes();
-        }
-
         if ((int)flags & (int)ScenePatchFlags::SplitMeshesPerMaterial)
             lGeomConverter.SplitMeshesPerMaterial(context->scene, /*replace*/true);
 
@@ -255,6 +251,24 @@ namespace {
             }
         }
 
+        // Materials are assigned per node, so an instanced mesh is only extracted once per set of materials
+        std::map<std::pair<FbxNodeAttribute*, std::vector<FbxSurfaceMaterial*>>, int> meshIds;
+        for (int i = 0; i < context->info->transforms.GetCount(); ++i) {
+            FbxNode* node = context->info->transforms[i];
+            FbxNodeAttribute* attribute = node->GetNodeAttribute();
+            if (!attribute || attribute->GetAttributeType() != FbxNodeAttribute::eMesh) {
+                context->info->transformMeshIds.Add(-1);
+                continue;
+            }
+            std::vector<FbxSurfaceMaterial*> materials;
+            for (int j = 0; j < node->GetMaterialCount(); ++j)
+                materials.push_back(node->GetMaterial(j));
+            auto inserted = meshIds.emplace(std::make_pair(attribute, materials), context->info->meshNodes.GetCount());
+            if (inserted.second)
+                context->info->meshNodes.Add(node);
+            context->info->transformMeshIds.Add(inserted.first->second);
+        }
+
         if (warnings.size() > 0) {
             context->errorCode = ErrorCode::WARNING;
             context->errorMessage = makeString(warnings);
@@ -1,8 +1,13 @@
 #pragma once
 
 #include <fbxsdk/scene/fbxaxissystem.h>
+#include <map>
+#include <unordered_map>
 
 #include "common.h"
+#include "spillFile.h"
+
+struct MultiMeshData;
 
 namespace TT_FBX {
     // This struct encapsulates some preprocessed data computed directly after import.
@@ -11,6 +16,19 @@ namespace TT_FBX {
     struct SceneInfo {
         FbxArray<FbxNode*> transforms;
         FbxArray<int> transformParentIds;
+        // Per transform, the index of its mesh in meshNodes, or -1. Transforms that instance the same mesh with the same materials share an index.
+        FbxArray<int> transformMeshIds;
+        // The transform each unique mesh is extracted from, the first one that uses it.
+        FbxArray<FbxNode*> meshNodes;
+
+        // Transform index per node name, the first node with a name wins. Built by the first findNode call.
+        std::unordered_map<std::string, int> nodeIds;
+        // Meshes extracted by extractMeshAt, keyed by the mesh node and the settings they were extracted with. Kept until freeExtractedMeshes or freeFbx.
+        std::map<std::pair<const FbxNode*, std::string>, const MultiMeshData*> extractedMeshes;
+        // Owns extractedMeshes, they are freed with the context.
+        Arena meshArena;
+        // Spills the buffers of extractedMeshes once they hold more than the memoryBudget of the current call, together.
+        BufferBudget meshBudget{ meshArena, 0, nullptr };
     };
 }
 
@@ -44,6 +62,7 @@ extern "C" {
         ConvertNurbsToPolygons = 1 << 0,
         Triangulate = 1 << 1,
         RemoveBadPolygons = 1 << 2,
+        // Not supported, merging here would lose the nodes and their materials. Use buildStaticBatches after importing, see staticBatcher.h.
         CollapseMeshes = 1 << 3,
         SplitMeshesPerMaterial = 1 << 4,
         CenterScene = 1 << 5,
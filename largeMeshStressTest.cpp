@@ -0,0 +1,168 @@
+#include <fbxsdk.h>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "meshParser.h"
+#include "spillFile.h"
+
+// Opt-in stress test for meshes with more than 4 GiB of vertices and of indices, only built with TT_FBX_STRESS_TESTS defined,
+// which the StressTest|x64 configuration does. Extracting the synthetic mesh takes about 24 GB of memory and 10 GB of disk
+// in the spill directory, and a few minutes.
+// Run it from python with api.initialize('StressTest').runLargeMeshStressTest(None), failed checks are printed to stdout.
+#ifdef TT_FBX_STRESS_TESTS
+namespace {
+    // Every polygon loops over a ring of control points several times. Normals and uvs are stored per polygon,
+    // so a polygon has RING_SIZE vertices of its own that its triangle fan reuses: 26.9M vertices and 1.29G indices.
+    constexpr int POLYGON_COUNT = 420 * 1000;
+    constexpr int POLYGON_SIZE = 1024;
+    constexpr int RING_SIZE = 64;
+    constexpr int LAYER_COUNT = 8;
+    // Position, the normals and the uvs.
+    constexpr uint64_t STRIDE = 12 + LAYER_COUNT * 12 + LAYER_COUNT * 8;
+    constexpr uint64_t VERTEX_COUNT = (uint64_t)POLYGON_COUNT * RING_SIZE;
+    constexpr uint64_t INDEX_COUNT = (uint64_t)POLYGON_COUNT * 3 * (POLYGON_SIZE - 2);
+    constexpr uint64_t FOUR_GIB = 4ull << 30;
+    static_assert(VERTEX_COUNT * STRIDE > FOUR_GIB && INDEX_COUNT * sizeof(uint32_t) > FOUR_GIB, "The mesh must cross 4 GiB");
+    static_assert(VERTEX_COUNT * (STRIDE - 8) > FOUR_GIB, "The last stream must start past 4 GiB");
+    static_assert(INDEX_COUNT < (1ull << 32), "Index counts are 32 bit");
+
+    FbxNode* createMesh(FbxScene* scene) {
+        FbxMesh* mesh = FbxMesh::Create(scene, "large");
+        mesh->InitControlPoints(RING_SIZE);
+        for (int i = 0; i < RING_SIZE; ++i)
+            mesh->SetControlPointAt(FbxVector4(i, 0.0, 0.0), i);
+
+        for (int layer = 0; layer < LAYER_COUNT; ++layer) {
+            FbxGeometryElementNormal* normals = mesh->CreateElementNormal();
+            normals->SetMappingMode(FbxGeometryElement::eByPolygon);
+            normals->SetReferenceMode(FbxGeometryElement::eDirect);
+            std::string name = "uv" + std::to_string(layer);
+            FbxGeometryElementUV* uvs = mesh->CreateElementUV(name.c_str());
+            uvs->SetMappingMode(FbxGeometryElement::eByPolygon);
+            uvs->SetReferenceMode(FbxGeometryElement::eDirect);
+            for (int polygon = 0; polygon < POLYGON_COUNT; ++polygon) {
+                normals->GetDirectArray().Add(FbxVector4(polygon, layer, 1.0));
+                uvs->GetDirectArray().Add(FbxVector2(polygon, layer));
+            }
+        }
+
+        mesh->ReservePolygonCount(POLYGON_COUNT);
+        mesh->ReservePolygonVertexCount(POLYGON_COUNT * POLYGON_SIZE);
+        for (int polygon = 0; polygon < POLYGON_COUNT; ++polygon) {
+            mesh->BeginPolygon(-1, -1, -1, false);
+            for (int corner = 0; corner < POLYGON_SIZE; ++corner)
+                mesh->AddPolygon(corner % RING_SIZE);
+            mesh->EndPolygon();
+        }
+
+        FbxNode* node = FbxNode::Create(scene, "large");
+        node->SetNodeAttribute(mesh);
+        scene->GetRootNode()->AddChild(node);
+        return node;
+    }
+
+    bool expect(bool condition, const char* what) {
+        if (!condition)
+            printf("runLargeMeshStressTest: %s failed\n", what);
+        return condition;
+    }
+
+    // Vertex v is corner v % RING_SIZE of polygon v / RING_SIZE, the first corners of a polygon are the first to use its vertices.
+    bool expectVertex(const uint8_t* positions, const uint8_t* lastUv, uint64_t vertex) {
+        float position[3];
+        memcpy(position, positions, sizeof(position));
+        float uv[2];
+        memcpy(uv, lastUv, sizeof(uv));
+        return expect(position[0] == (float)(vertex % RING_SIZE) && position[1] == 0.0f && position[2] == 0.0f, "position past 4 GiB") &&
+            expect(uv[0] == (float)(vertex / RING_SIZE) && uv[1] == (float)(LAYER_COUNT - 1), "uv past 4 GiB");
+    }
+
+    // The fan of the last polygon ends with its last corner, the one before it and its first corner.
+    bool expectIndices(const uint8_t* indexData, uint32_t baseVertex) {
+        uint32_t last[3];
+        memcpy(last, indexData + (INDEX_COUNT - 3) * sizeof(uint32_t), sizeof(last));
+        uint64_t firstVertex = VERTEX_COUNT - RING_SIZE;
+        return expect(last[0] + baseVertex == firstVertex + (POLYGON_SIZE - 1) % RING_SIZE, "last fan corner") &&
+            expect(last[2] + baseVertex == firstVertex, "last fan anchor");
+    }
+
+    // One stream per attribute, so the last uv stream starts past 4 GiB.
+    bool testSeparateBuffers(const FbxNode* node, const char* spillDirectory) {
+        MeshExtractSettings settings;
+        settings.streamMode = VertexStreamMode::PerAttribute;
+        settings.memoryBudget = 1ull << 30;
+        settings.spillDirectory = spillDirectory;
+        TT_FBX::Arena arena;
+        TT_FBX::BufferBudget budget(arena, settings.memoryBudget, settings.spillDirectory);
+        MultiMeshData mesh = TT_FBX::extractMesh(node, FbxArray<FbxNode*>(), settings, arena, budget);
+        if (!expect(mesh.meshCount == 1 && mesh.streamCount == 1 + 2 * LAYER_COUNT, "separate buffer layout"))
+            return false;
+
+        const MeshData& subMesh = mesh.meshes[0];
+        bool ok = expect(subMesh.vertexCount == VERTEX_COUNT, "vertexCount");
+        ok &= expect(subMesh.vertexDataSizeInBytes == VERTEX_COUNT * STRIDE, "vertexDataSizeInBytes");
+        ok &= expect(subMesh.indexCount == INDEX_COUNT, "indexCount");
+        ok &= expect(subMesh.indexDataSizeInBytes == INDEX_COUNT * sizeof(uint32_t), "indexDataSizeInBytes");
+        std::vector<uint64_t> strides(mesh.streamCount);
+        for (uint32_t i = 0; i < mesh.attributeCount; ++i)
+            strides[mesh.attributeLayout[i].stream] = mesh.attributeLayout[i].stride;
+        uint64_t expectedOffset = 0;
+        for (uint32_t i = 0; i < mesh.streamCount; ++i) {
+            ok &= expect(subMesh.streamOffsets[i] == expectedOffset, "streamOffsets");
+            expectedOffset += strides[i] * VERTEX_COUNT;
+        }
+        if (!ok)
+            return false;
+
+        uint64_t vertex = VERTEX_COUNT - 1;
+        const uint8_t* lastUvStream = subMesh.vertexDataBlob + subMesh.streamOffsets[mesh.streamCount - 1];
+        return expectVertex(subMesh.vertexDataBlob + vertex * 12, lastUvStream + vertex * 8, vertex) &&
+            expectIndices(subMesh.indexDataBlob, subMesh.baseVertex);
+    }
+
+    // One interleaved shared vertex buffer, which covers the shared sizes instead.
+    bool testSharedBuffers(const FbxNode* node, const char* spillDirectory) {
+        MeshExtractSettings settings;
+        settings.flags = MeshExtractFlags::SharedVertexBuffer;
+        settings.memoryBudget = 1ull << 30;
+        settings.spillDirectory = spillDirectory;
+        TT_FBX::Arena arena;
+        TT_FBX::BufferBudget budget(arena, settings.memoryBudget, settings.spillDirectory);
+        MultiMeshData mesh = TT_FBX::extractMesh(node, FbxArray<FbxNode*>(), settings, arena, budget);
+        if (!expect(mesh.meshCount == 1 && mesh.streamCount == 1, "shared buffer layout"))
+            return false;
+
+        const MeshData& subMesh = mesh.meshes[0];
+        bool ok = expect(mesh.sharedVertexCount == VERTEX_COUNT, "sharedVertexCount");
+        ok &= expect(mesh.sharedVertexDataSizeInBytes == VERTEX_COUNT * STRIDE, "sharedVertexDataSizeInBytes");
+        ok &= expect(mesh.sharedIndexDataSizeInBytes == INDEX_COUNT * sizeof(uint32_t), "sharedIndexDataSizeInBytes");
+        ok &= expect(mesh.sharedStreamOffsets[0] == 0, "sharedStreamOffsets");
+        ok &= expect(subMesh.firstIndex == 0 && subMesh.indexCount == INDEX_COUNT, "submesh index range");
+        ok &= expect(subMesh.vertexDataSizeInBytes == 0 && subMesh.indexDataSizeInBytes == 0, "submesh sizes");
+        if (!ok)
+            return false;
+
+        uint64_t vertex = VERTEX_COUNT - 1;
+        const uint8_t* lastVertex = mesh.sharedVertexDataBlob + vertex * STRIDE;
+        return expectVertex(lastVertex, lastVertex + STRIDE - 8, vertex) &&
+            expectIndices(mesh.sharedIndexDataBlob, subMesh.baseVertex);
+    }
+}
+
+extern "C" {
+    // Returns true if every check passed. spillDirectory may be nullptr for the system temp directory.
+    __declspec(dllexport) bool runLargeMeshStressTest(const char* spillDirectory) {
+        FbxManager* manager = FbxManager::Create();
+        FbxScene* scene = FbxScene::Create(manager, "");
+        FbxNode* node = createMesh(scene);
+        // Separately, so only one result is in memory at a time
+        bool ok = testSeparateBuffers(node, spillDirectory);
+        ok &= testSharedBuffers(node, spillDirectory);
+        manager->Destroy();
+        printf("runLargeMeshStressTest: %s\n", ok ? "passed" : "failed");
+        return ok;
+    }
+}
+#endif
@@ -0,0 +1,401 @@
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define TT_FBX_SSE
+#endif
+
+#include "meshCodec.h"
+
+namespace {
+    // First byte of every encoded buffer, the low nibble is the format version.
+    constexpr uint8_t VERTEX_HEADER = 0xA1;
+    constexpr uint8_t INDEX_HEADER = 0xB1;
+
+    // Vertices are coded in blocks, so the decoder only needs a small transposed scratch buffer.
+    constexpr size_t BLOCK_VERTICES = 256;
+    constexpr size_t GROUP_SIZE = 16;
+
+    // Bits per value of a group for each 2 bit group header value.
+    constexpr int GROUP_BITS[4] = { 0, 2, 4, 8 };
+
+    inline uint8_t zigzag8(uint8_t delta) { return (uint8_t)((delta << 1) ^ (uint8_t)((int8_t)delta >> 7)); }
+    inline uint8_t unzigzag8(uint8_t value) { return (uint8_t)((value >> 1) ^ (uint8_t)-(int)(value & 1)); }
+    inline uint32_t zigzag32(uint32_t delta) { return (delta << 1) ^ (uint32_t)((int32_t)delta >> 31); }
+    inline uint32_t unzigzag32(uint32_t value) { return (value >> 1) ^ (uint32_t)-(int32_t)(value & 1); }
+
+    inline size_t groupCount(size_t vertexCount) { return (vertexCount + GROUP_SIZE - 1) / GROUP_SIZE; }
+
+    // Header bits plus the largest payload for every group of every lane.
+    inline size_t blockBound(size_t vertexCount, size_t vertexSize) {
+        size_t groups = groupCount(vertexCount);
+        return vertexSize * ((groups + 3) / 4 + groups * GROUP_SIZE);
+    }
+
+    // Pack one lane of a block, values are the zigzagged deltas padded with zeros to whole groups.
+    uint8_t* encodeLane(uint8_t* output, const uint8_t* values, size_t groups) {
+        uint8_t* header = output;
+        size_t headerSize = (groups + 3) / 4;
+        memset(header, 0, headerSize);
+        output += headerSize;
+
+        for (size_t group = 0; group < groups; ++group) {
+            const uint8_t* v = values + group * GROUP_SIZE;
+            uint8_t largest = *std::max_element(v, v + GROUP_SIZE);
+            int mode = largest == 0 ? 0 : largest < 4 ? 1 : largest < 16 ? 2 : 3;
+            header[group / 4] |= (uint8_t)(mode << ((group % 4) * 2));
+            switch (mode) {
+            case 1:
+                // Byte j holds values j, j + 4, j + 8 and j + 12
+                for (int j = 0; j < 4; ++j)
+                    output[j] = (uint8_t)(v[j] | (v[j + 4] << 2) | (v[j + 8] << 4) | (v[j + 12] << 6));
+                output += 4;
+                break;
+            case 2:
+                // Byte j holds values j and j + 8
+                for (int j = 0; j < 8; ++j)
+                    output[j] = (uint8_t)(v[j] | (v[j + 8] << 4));
+                output += 8;
+                break;
+            case 3:
+                memcpy(output, v, GROUP_SIZE);
+                output += GROUP_SIZE;
+                break;
+            }
+        }
+        return output;
+    }
+
+#ifdef TT_FBX_SSE
+    inline __m128i unzigzag(__m128i value) {
+        __m128i half = _mm_and_si128(_mm_srli_epi16(value, 1), _mm_set1_epi8(0x7F));
+        __m128i sign = _mm_sub_epi8(_mm_setzero_si128(), _mm_and_si128(value, _mm_set1_epi8(1)));
+        return _mm_xor_si128(half, sign);
+    }
+
+    inline __m128i unpackGroup(const uint8_t* input, int mode) {
+        switch (mode) {
+        case 1: {
+            int packed;
+            memcpy(&packed, input, sizeof(packed));
+            __m128i x = _mm_cvtsi32_si128(packed);
+            __m128i mask = _mm_set1_epi8(3);
+            __m128i a = _mm_and_si128(x, mask);
+            __m128i b = _mm_and_si128(_mm_srli_epi16(x, 2), mask);
+            __m128i c = _mm_and_si128(_mm_srli_epi16(x, 4), mask);
+            __m128i d = _mm_and_si128(_mm_srli_epi16(x, 6), mask);
+            return _mm_unpacklo_epi64(_mm_unpacklo_epi32(a, b), _mm_unpacklo_epi32(c, d));
+        }
+        case 2: {
+            __m128i x = _mm_loadl_epi64((const __m128i*)input);
+            __m128i mask = _mm_set1_epi8(15);
+            return _mm_unpacklo_epi64(_mm_and_si128(x, mask), _mm_and_si128(_mm_srli_epi16(x, 4), mask));
+        }
+        case 3:
+            return _mm_loadu_si128((const __m128i*)input);
+        default:
+            return _mm_setzero_si128();
+        }
+    }
+
+    // Four rounds of interleaving row i with row i + 8 transpose a 16x16 byte tile.
+    inline void transpose16x16(__m128i* rows) {
+        __m128i next[16];
+        for (int round = 0; round < 4; ++round) {
+            for (int i = 0; i < 8; ++i) {
+                next[i * 2] = _mm_unpacklo_epi8(rows[i], rows[i + 8]);
+                next[i * 2 + 1] = _mm_unpackhi_epi8(rows[i], rows[i + 8]);
+            }
+            memcpy(rows, next, sizeof(next));
+        }
+    }
+#endif
+
+    // Unpack one lane of a block into deltas, returns nullptr if the input runs out.
+    const uint8_t* decodeLane(const uint8_t* input, const uint8_t* end, uint8_t* deltas, size_t groups) {
+        size_t headerSize = (groups + 3) / 4;
+        if ((size_t)(end - input) < headerSize)
+            return nullptr;
+        const uint8_t* header = input;
+        input += headerSize;
+
+        for (size_t group = 0; group < groups; ++group) {
+            int mode = (header[group / 4] >> ((group % 4) * 2)) & 3;
+            size_t size = GROUP_BITS[mode] * GROUP_SIZE / 8;
+            if ((size_t)(end - input) < size)
+                return nullptr;
+            uint8_t* v = deltas + group * GROUP_SIZE;
+#ifdef TT_FBX_SSE
+            _mm_storeu_si128((__m128i*)v, unzigzag(unpackGroup(input, mode)));
+#else
+            for (int j = 0; j < (int)GROUP_SIZE; ++j) {
+                uint8_t value = 0;
+                if (mode == 1)
+                    value = (input[j % 4] >> ((j / 4) * 2)) & 3;
+                else if (mode == 2)
+                    value = (input[j % 8] >> ((j / 8) * 4)) & 15;
+                else if (mode == 3)
+                    value = input[j];
+                v[j] = unzigzag8(value);
+            }
+#endif
+            input += size;
+        }
+        return input;
+    }
+
+    // Add the deltas of a block to the previous vertex and write the vertices out.
+    // deltas holds a row of BLOCK_VERTICES per byte lane, previous holds the last decoded vertex.
+    void reconstructBlock(uint8_t* output, const uint8_t* deltas, size_t vertexCount, size_t vertexSize, uint8_t* previous) {
+        size_t lane = 0;
+#ifdef TT_FBX_SSE
+        // 16 lanes of 16 vertices at a time, transposed back to vertex order in registers
+        for (; lane + 16 <= vertexSize; lane += 16) {
+            __m128i current = _mm_loadu_si128((const __m128i*)(previous + lane));
+            for (size_t first = 0; first < vertexCount; first += GROUP_SIZE) {
+                __m128i rows[16];
+                for (int i = 0; i < 16; ++i)
+                    rows[i] = _mm_loadu_si128((const __m128i*)(deltas + (lane + i) * BLOCK_VERTICES + first));
+                transpose16x16(rows);
+                size_t count = std::min(GROUP_SIZE, vertexCount - first);
+                for (size_t i = 0; i < count; ++i) {
+                    current = _mm_add_epi8(current, rows[i]);
+                    _mm_storeu_si128((__m128i*)(output + (first + i) * vertexSize + lane), current);
+                }
+            }
+            _mm_storeu_si128((__m128i*)(previous + lane), current);
+        }
+#endif
+        for (; lane < vertexSize; ++lane) {
+            uint8_t current = previous[lane];
+            const uint8_t* row = deltas + lane * BLOCK_VERTICES;
+            for (size_t i = 0; i < vertexCount; ++i) {
+                current = (uint8_t)(current + row[i]);
+                output[i * vertexSize + lane] = current;
+            }
+            previous[lane] = current;
+        }
+    }
+
+    inline uint8_t* writeVarint(uint8_t* output, uint32_t value) {
+        while (value >= 0x80) {
+            *output++ = (uint8_t)(value | 0x80);
+            value >>= 7;
+        }
+        *output++ = (uint8_t)value;
+        return output;
+    }
+
+    inline const uint8_t* readVarint(const uint8_t* input, const uint8_t* end, uint32_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 35 && input < end; shift += 7) {
+            uint8_t byte = *input++;
+            value |= (uint32_t)(byte & 0x7F) << shift;
+            if (!(byte & 0x80))
+                return input;
+        }
+        return nullptr;
+    }
+
+    // The edges most recently seen by the index codec, stored reversed so they match the neighbouring triangle.
+    struct EdgeFifo {
+        static constexpr int SIZE = 16;
+        uint32_t edges[SIZE][2];
+        int cursor = 0;
+
+        EdgeFifo() {
+            for (int i = 0; i < SIZE; ++i)
+                edges[i][0] = edges[i][1] = ~0u;
+        }
+
+        void push(uint32_t a, uint32_t b) {
+            edges[cursor][0] = a;
+            edges[cursor][1] = b;
+            cursor = (cursor + 1) % SIZE;
+        }
+
+        void pushTriangle(uint32_t a, uint32_t b, uint32_t c) {
+            push(b, a);
+            push(c, b);
+            push(a, c);
+        }
+
+        // Slot relative to the most recent edge, or -1.
+        int find(uint32_t a, uint32_t b) const {
+            for (int i = 0; i < SIZE; ++i) {
+                int slot = (cursor - 1 - i + SIZE) % SIZE;
+                if (edges[slot][0] == a && edges[slot][1] == b)
+                    return i;
+            }
+            return -1;
+        }
+
+        const uint32_t* get(int i) const { return edges[(cursor - 1 - i + SIZE) % SIZE]; }
+    };
+
+    // Index codec triangle kinds, in the high nibble of the code byte, the low nibble is the edge slot.
+    enum TriangleCode : uint8_t {
+        // Shares an edge, the third vertex is the next unused vertex.
+        EdgeNewVertex = 0x00,
+        // Shares an edge, the third vertex is stored as a delta to the previous third vertex.
+        EdgeVertex = 0x10,
+        // All three vertices are stored as deltas.
+        Free = 0x20,
+    };
+}
+
+extern "C" {
+    __declspec(dllexport) size_t encodeVertexBufferBound(size_t vertexCount, size_t vertexSize) {
+        size_t fullBlocks = vertexCount / BLOCK_VERTICES;
+        return 1 + fullBlocks * blockBound(BLOCK_VERTICES, vertexSize) + blockBound(vertexCount % BLOCK_VERTICES, vertexSize);
+    }
+
+    __declspec(dllexport) size_t encodeVertexBuffer(uint8_t* buffer, size_t bufferSize, const void* vertices, size_t vertexCount, size_t vertexSize) {
+        if (vertexSize == 0 || vertexSize % 4 != 0 || bufferSize < encodeVertexBufferBound(vertexCount, vertexSize))
+            return 0;
+
+        const uint8_t* input = (const uint8_t*)vertices;
+        uint8_t* output = buffer;
+        *output++ = VERTEX_HEADER;
+        std::vector<uint8_t> previous(vertexSize, 0);
+        uint8_t values[BLOCK_VERTICES];
+        for (size_t first = 0; first < vertexCount; first += BLOCK_VERTICES) {
+            size_t count = std::min(BLOCK_VERTICES, vertexCount - first);
+            size_t groups = groupCount(count);
+            for (size_t lane = 0; lane < vertexSize; ++lane) {
+                memset(values, 0, sizeof(values));
+                uint8_t last = previous[lane];
+                for (size_t i = 0; i < count; ++i) {
+                    uint8_t current = input[(first + i) * vertexSize + lane];
+                    values[i] = zigzag8((uint8_t)(current - last));
+                    last = current;
+                }
+                previous[lane] = last;
+                output = encodeLane(output, values, groups);
+            }
+        }
+        return output - buffer;
+    }
+
+    __declspec(dllexport) bool decodeVertexBuffer(void* destination, size_t vertexCount, size_t vertexSize, const uint8_t* buffer, size_t bufferSize) {
+        if (vertexSize == 0 || vertexSize % 4 != 0 || bufferSize < 1 || buffer[0] != VERTEX_HEADER)
+            return false;
+
+        const uint8_t* input = buffer + 1;
+        const uint8_t* end = buffer + bufferSize;
+        uint8_t* output = (uint8_t*)destination;
+        std::vector<uint8_t> previous(vertexSize, 0);
+        std::vector<uint8_t> deltas(vertexSize * BLOCK_VERTICES);
+        for (size_t first = 0; first < vertexCount; first += BLOCK_VERTICES) {
+            size_t count = std::min(BLOCK_VERTICES, vertexCount - first);
+            size_t groups = groupCount(count);
+            for (size_t lane = 0; lane < vertexSize; ++lane) {
+                input = decodeLane(input, end, deltas.data() + lane * BLOCK_VERTICES, groups);
+                if (!input)
+                    return false;
+            }
+            reconstructBlock(output + first * vertexSize, deltas.data(), count, vertexSize, previous.data());
+        }
+        return input == end;
+    }
+
+    __declspec(dllexport) size_t encodeIndexBufferBound(size_t indexCount) {
+        // A code byte and at most 3 varints of 5 bytes per triangle
+        return 1 + indexCount / 3 * 16;
+    }
+
+    __declspec(dllexport) size_t encodeIndexBuffer(uint8_t* buffer, size_t bufferSize, const uint32_t* indices, size_t indexCount) {
+        if (indexCount % 3 != 0 || bufferSize < encodeIndexBufferBound(indexCount))
+            return 0;
+
+        uint8_t* output = buffer;
+        *output++ = INDEX_HEADER;
+        EdgeFifo fifo;
+        uint32_t next = 0;
+        uint32_t last = 0;
+        for (size_t i = 0; i < indexCount; i += 3) {
+            const uint32_t* triangle = indices + i;
+            // Rotate the triangle so its first edge is a recent one, if any
+            int slot = -1;
+            int rotation = 0;
+            for (; rotation < 3 && slot < 0; ++rotation)
+                slot = fifo.find(triangle[rotation], triangle[(rotation + 1) % 3]);
+            rotation = slot < 0 ? 0 : rotation - 1;
+            uint32_t a = triangle[rotation];
+            uint32_t b = triangle[(rotation + 1) % 3];
+            uint32_t c = triangle[(rotation + 2) % 3];
+
+            if (slot >= 0 && c == next) {
+                *output++ = (uint8_t)(EdgeNewVertex | slot);
+            } else if (slot >= 0) {
+                *output++ = (uint8_t)(EdgeVertex | slot);
+                output = writeVarint(output, zigzag32(c - last));
+            } else {
+                *output++ = Free;
+                output = writeVarint(output, zigzag32(a - last));
+                output = writeVarint(output, zigzag32(b - a));
+                output = writeVarint(output, zigzag32(c - b));
+            }
+            last = c;
+            next = std::max(next, std::max(a, std::max(b, c)) + 1);
+            fifo.pushTriangle(a, b, c);
+        }
+        return output - buffer;
+    }
+
+    __declspec(dllexport) bool decodeIndexBuffer(uint32_t* destination, size_t indexCount, const uint8_t* buffer, size_t bufferSize) {
+        if (indexCount % 3 != 0 || bufferSize < 1 || buffer[0] != INDEX_HEADER)
+            return false;
+
+        const uint8_t* input = buffer + 1;
+        const uint8_t* end = buffer + bufferSize;
+        EdgeFifo fifo;
+        uint32_t next = 0;
+        uint32_t last = 0;
+        for (size_t i = 0; i < indexCount; i += 3) {
+            if (input >= end)
+                return false;
+            uint8_t code = *input++;
+            uint8_t kind = code & 0xF0;
+            int slot = code & 0x0F;
+            uint32_t a, b, c;
+            if (kind == EdgeNewVertex || kind == EdgeVertex) {
+                const uint32_t* edge = fifo.get(slot);
+                a = edge[0];
+                b = edge[1];
+                if (kind == EdgeNewVertex) {
+                    c = next;
+                } else {
+                    uint32_t delta;
+                    if (!(input = readVarint(input, end, delta)))
+                        return false;
+                    c = last + unzigzag32(delta);
+                }
+            } else if (kind == Free) {
+                uint32_t deltas[3];
+                for (uint32_t& delta : deltas) {
+                    if (!(input = readVarint(input, end, delta)))
+                        return false;
+                }
+                a = last + unzigzag32(deltas[0]);
+                b = a + unzigzag32(deltas[1]);
+                c = b + unzigzag32(deltas[2]);
+            } else {
+                return false;
+            }
+            // Slots that were never filled hold ~0u
+            if (a == ~0u || b == ~0u)
+                return false;
+
+            destination[i] = a;
+            destination[i + 1] = b;
+            destination[i + 2] = c;
+            last = c;
+            next = std::max(next, std::max(a, std::max(b, c)) + 1);
+            fifo.pushTriangle(a, b, c);
+        }
+        return input == end;
+    }
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+extern "C" {
+    // Lossless compression of vertex and index buffers, for storing meshes on disk.
+    //
+    // Vertices are split into byte lanes, every byte is delta coded against the same byte of the previous vertex
+    // and bit packed per 16 vertices at 0, 2, 4 or 8 bits. Float attributes compress well this way because the sign
+    // and exponent bytes rarely change between neighbouring vertices, so run MeshExtractFlags::OptimizeVertexFetch first.
+    //
+    // Triangles are coded against the 16 most recently seen edges. A triangle that shares an edge with a recent one
+    // costs a single byte when its third vertex is new, so run MeshExtractFlags::OptimizeVertexCache first.
+
+    // Largest possible size of an encoded vertex buffer.
+    __declspec(dllexport) size_t encodeVertexBufferBound(size_t vertexCount, size_t vertexSize);
+    // vertexSize must be a multiple of 4, like every layout extractMeshes produces.
+    // Returns the encoded size, or 0 if the arguments are invalid or the buffer is smaller than encodeVertexBufferBound.
+    __declspec(dllexport) size_t encodeVertexBuffer(uint8_t* buffer, size_t bufferSize, const void* vertices, size_t vertexCount, size_t vertexSize);
+    // Returns false if the data is corrupt or was not encoded with this vertexCount and vertexSize.
+    __declspec(dllexport) bool decodeVertexBuffer(void* destination, size_t vertexCount, size_t vertexSize, const uint8_t* buffer, size_t bufferSize);
+
+    // Largest possible size of an encoded index buffer.
+    __declspec(dllexport) size_t encodeIndexBufferBound(size_t indexCount);
+    // Triangle lists only, indexCount must be a multiple of 3. Triangles may be rotated, their winding is kept.
+    // Returns the encoded size, or 0 if the arguments are invalid or the buffer is smaller than encodeIndexBufferBound.
+    __declspec(dllexport) size_t encodeIndexBuffer(uint8_t* buffer, size_t bufferSize, const uint32_t* indices, size_t indexCount);
+    // Returns false if the data is corrupt or was not encoded with this indexCount.
+    __declspec(dllexport) bool decodeIndexBuffer(uint32_t* destination, size_t indexCount, const uint8_t* buffer, size_t bufferSize);
+}
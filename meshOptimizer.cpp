@@ -0,0 +1,302 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "meshOptimizer.h"
+
+namespace {
+    struct Position {
+        float x = 0.0f;
+        float y = 0.0f;
+        float z = 0.0f;
+    };
+
+    inline Position readPosition(const uint8_t* vertexData, size_t stride, uint32_t index) {
+        Position result;
+        memcpy(&result, vertexData + index * stride, sizeof(Position));
+        return result;
+    }
+
+    // Models a FIFO post-transform cache. A vertex is in the cache if less than cacheSize misses happened since it was inserted.
+    struct FifoCache {
+        std::vector<uint32_t> timestamps;
+        uint32_t timestamp = TT_FBX::VERTEX_CACHE_SIZE + 1;
+
+        explicit FifoCache(size_t vertexCount) : timestamps(vertexCount, 0) {}
+
+        // Returns 1 on a cache miss, 0 on a hit.
+        uint32_t access(uint32_t vertex) {
+            if (timestamp - timestamps[vertex] > TT_FBX::VERTEX_CACHE_SIZE) {
+                timestamps[vertex] = timestamp++;
+                return 1;
+            }
+            return 0;
+        }
+
+        // Evict everything by advancing time past every entry.
+        void flush() {
+            timestamp += TT_FBX::VERTEX_CACHE_SIZE + 1;
+        }
+    };
+
+    // Tipsify leaves a triangle list where each place that all 3 vertices miss the cache is a jump to a new fan.
+    // Those jumps are the natural cluster boundaries.
+    std::vector<size_t> findHardBoundaries(const std::vector<uint32_t>& indices, size_t vertexCount) {
+        std::vector<size_t> boundaries;
+        FifoCache cache(vertexCount);
+        size_t triangleCount = indices.size() / 3;
+        for (size_t t = 0; t < triangleCount; ++t) {
+            uint32_t misses = cache.access(indices[t * 3]) + cache.access(indices[t * 3 + 1]) + cache.access(indices[t * 3 + 2]);
+            if (t == 0 || misses == 3)
+                boundaries.push_back(t);
+        }
+        boundaries.push_back(triangleCount);
+        return boundaries;
+    }
+
+    // Split hard clusters further wherever the cache miss ratio of the cluster so far is within the threshold of the entire cluster.
+    // Smaller clusters give the sort more freedom, at the cost of restarting with a cold cache at every boundary.
+    std::vector<size_t> findSoftBoundaries(const std::vector<uint32_t>& indices, size_t vertexCount, const std::vector<size_t>& hardBoundaries, float threshold) {
+        std::vector<size_t> boundaries;
+        FifoCache cache(vertexCount);
+        for (size_t cluster = 0; cluster + 1 < hardBoundaries.size(); ++cluster) {
+            size_t start = hardBoundaries[cluster];
+            size_t end = hardBoundaries[cluster + 1];
+
+            // Measure the cache efficiency of the whole cluster
+            cache.flush();
+            uint32_t clusterMisses = 0;
+            for (size_t t = start; t < end; ++t)
+                clusterMisses += cache.access(indices[t * 3]) + cache.access(indices[t * 3 + 1]) + cache.access(indices[t * 3 + 2]);
+            float clusterThreshold = threshold * (float)clusterMisses / (float)(end - start);
+
+            // Cut whenever we are doing at least as well as the whole cluster (within tolerance)
+            cache.flush();
+            boundaries.push_back(start);
+            size_t subStart = start;
+            uint32_t subMisses = 0;
+            for (size_t t = start; t < end; ++t) {
+                subMisses += cache.access(indices[t * 3]) + cache.access(indices[t * 3 + 1]) + cache.access(indices[t * 3 + 2]);
+                if (t + 1 < end && (float)subMisses / (float)(t - subStart + 1) <= clusterThreshold) {
+                    boundaries.push_back(t + 1);
+                    subStart = t + 1;
+                    subMisses = 0;
+                    cache.flush();
+                }
+            }
+        }
+        boundaries.push_back(indices.size() / 3);
+        return boundaries;
+    }
+}
+
+namespace TT_FBX {
+    TriangleAdjacency buildTriangleAdjacency(const std::vector<uint32_t>& indices, size_t vertexCount) {
+        TriangleAdjacency result;
+        result.counts.assign(vertexCount, 0);
+        for (uint32_t index : indices)
+            result.counts[index]++;
+
+        result.offsets.assign(vertexCount + 1, 0);
+        for (size_t v = 0; v < vertexCount; ++v)
+            result.offsets[v + 1] = result.offsets[v] + result.counts[v];
+
+        result.triangles.resize(indices.size());
+        std::vector<uint32_t> fillCursor(result.offsets.begin(), result.offsets.end() - 1);
+        for (size_t i = 0; i < indices.size(); ++i)
+            result.triangles[fillCursor[indices[i]]++] = (uint32_t)(i / 3);
+        return result;
+    }
+
+    void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount) {
+        size_t triangleCount = indices.size() / 3;
+        if (triangleCount == 0 || vertexCount == 0)
+            return;
+
+        TriangleAdjacency adjacency = buildTriangleAdjacency(indices, vertexCount);
+        // Count how many triangles still need to be emitted for each vertex
+        std::vector<uint32_t> liveTriangles = adjacency.counts;
+
+        std::vector<uint32_t> cacheTimestamps(vertexCount, 0);
+        std::vector<bool> emitted(triangleCount, false);
+        // Recently referenced vertices, used to find a good place to continue when we run out of candidates
+        std::vector<uint32_t> deadEndStack;
+        std::vector<uint32_t> candidates;
+        std::vector<uint32_t> result;
+        result.reserve(indices.size());
+
+        uint32_t timestamp = VERTEX_CACHE_SIZE + 1;
+        size_t inputCursor = 0;
+        int64_t fanningVertex = indices[0];
+        while (fanningVertex >= 0) {
+            // Emit all remaining triangles around the fanning vertex
+            candidates.clear();
+            for (uint32_t i = adjacency.offsets[fanningVertex]; i < adjacency.offsets[fanningVertex + 1]; ++i) {
+                uint32_t t = adjacency.triangles[i];
+                if (emitted[t])
+                    continue;
+                for (size_t k = 0; k < 3; ++k) {
+                    uint32_t v = indices[t * 3 + k];
+                    result.push_back(v);
+                    deadEndStack.push_back(v);
+                    candidates.push_back(v);
+                    liveTriangles[v]--;
+                    if (timestamp - cacheTimestamps[v] > VERTEX_CACHE_SIZE)
+                        cacheTimestamps[v] = timestamp++;
+                }
+                emitted[t] = true;
+            }
+
+            // Continue with the candidate that is in the cache and will still be after fanning it
+            fanningVertex = -1;
+            int64_t bestPriority = -1;
+            for (uint32_t v : candidates) {
+                if (liveTriangles[v] == 0)
+                    continue;
+                int64_t priority = 0;
+                if (timestamp - cacheTimestamps[v] + 2 * liveTriangles[v] <= VERTEX_CACHE_SIZE)
+                    priority = timestamp - cacheTimestamps[v];
+                if (priority > bestPriority) {
+                    bestPriority = priority;
+                    fanningVertex = v;
+                }
+            }
+
+            // No candidates, try recently used vertices first and then fall back to input order
+            while (fanningVertex < 0 && !deadEndStack.empty()) {
+                uint32_t v = deadEndStack.back();
+                deadEndStack.pop_back();
+                if (liveTriangles[v] > 0)
+                    fanningVertex = v;
+            }
+            while (fanningVertex < 0 && inputCursor < vertexCount) {
+                if (liveTriangles[inputCursor] > 0)
+                    fanningVertex = (int64_t)inputCursor;
+                ++inputCursor;
+            }
+        }
+
+        indices.swap(result);
+    }
+
+    void optimizeOverdraw(std::vector<uint32_t>& indices, const uint8_t* vertexData, size_t vertexCount, size_t stride, float threshold) {
+        size_t triangleCount = indices.size() / 3;
+        if (triangleCount == 0 || vertexCount == 0)
+            return;
+
+        std::vector<size_t> hardBoundaries = findHardBoundaries(indices, vertexCount);
+        std::vector<size_t> boundaries = findSoftBoundaries(indices, vertexCount, hardBoundaries, threshold);
+        size_t clusterCount = boundaries.size() - 1;
+
+        // The mesh centroid, we use the average of the referenced vertices
+        Position meshCentroid;
+        for (uint32_t index : indices) {
+            Position p = readPosition(vertexData, stride, index);
+            meshCentroid.x += p.x;
+            meshCentroid.y += p.y;
+            meshCentroid.z += p.z;
+        }
+        meshCentroid.x /= (float)indices.size();
+        meshCentroid.y /= (float)indices.size();
+        meshCentroid.z /= (float)indices.size();
+
+        // A cluster facing away from the center of the mesh is likely to occlude the rest of the mesh,
+        // so we sort by how far the cluster is in front of the centroid along its average normal.
+        std::vector<std::pair<float, size_t>> sortKeys(clusterCount);
+        for (size_t cluster = 0; cluster < clusterCount; ++cluster) {
+            Position centroid;
+            Position normal;
+            float totalArea = 0.0f;
+            for (size_t t = boundaries[cluster]; t < boundaries[cluster + 1]; ++t) {
+                Position a = readPosition(vertexData, stride, indices[t * 3]);
+                Position b = readPosition(vertexData, stride, indices[t * 3 + 1]);
+                Position c = readPosition(vertexData, stride, indices[t * 3 + 2]);
+                Position ab = { b.x - a.x, b.y - a.y, b.z - a.z };
+                Position ac = { c.x - a.x, c.y - a.y, c.z - a.z };
+                Position n = { ab.y * ac.z - ab.z * ac.y, ab.z * ac.x - ab.x * ac.z, ab.x * ac.y - ab.y * ac.x };
+                // The cross product length is twice the area, which is fine as a weight
+                float area = sqrtf(n.x * n.x + n.y * n.y + n.z * n.z);
+                centroid.x += (a.x + b.x + c.x) * (area / 3.0f);
+                centroid.y += (a.y + b.y + c.y) * (area / 3.0f);
+                centroid.z += (a.z + b.z + c.z) * (area / 3.0f);
+                normal.x += n.x;
+                normal.y += n.y;
+                normal.z += n.z;
+                totalArea += area;
+            }
+
+            float key = 0.0f;
+            float normalLength = sqrtf(normal.x * normal.x + normal.y * normal.y + normal.z * normal.z);
+            if (totalArea > 0.0f && normalLength > 0.0f) {
+                centroid.x = centroid.x / totalArea - meshCentroid.x;
+                centroid.y = centroid.y / totalArea - meshCentroid.y;
+                centroid.z = centroid.z / totalArea - meshCentroid.z;
+                key = (centroid.x * normal.x + centroid.y * normal.y + centroid.z * normal.z) / normalLength;
+            }
+            sortKeys[cluster] = { key, cluster };
+        }
+
+        // Highest occlusion potential first, keep the original order for ties so the result is deterministic
+        std::stable_sort(sortKeys.begin(), sortKeys.end(), [](const std::pair<float, size_t>& a, const std::pair<float, size_t>& b) { return a.first > b.first; });
+
+        std::vector<uint32_t> result;
+        result.reserve(indices.size());
+        for (const auto& pair : sortKeys)
+            result.insert(result.end(), indices.begin() + boundaries[pair.second] * 3, indices.begin() + boundaries[pair.second + 1] * 3);
+        indices.swap(result);
+    }
+
+    size_t buildVertexFetchRemap(const std::vector<uint32_t>& indices, size_t vertexCount, std::vector<uint32_t>& remap) {
+        remap.assign(vertexCount, UNUSED_VERTEX);
+        uint32_t nextVertex = 0;
+        for (uint32_t index : indices) {
+            if (remap[index] == UNUSED_VERTEX)
+                remap[index] = nextVertex++;
+        }
+        return nextVertex;
+    }
+
+    void remapIndices(std::vector<uint32_t>& indices, const std::vector<uint32_t>& remap) {
+        for (uint32_t& index : indices)
+            index = remap[index];
+    }
+
+    void remapVertices(std::vector<uint8_t>& vertexData, size_t stride, const std::vector<uint32_t>& remap, size_t newVertexCount) {
+        std::vector<uint8_t> result(newVertexCount * stride);
+        for (size_t v = 0; v < remap.size(); ++v) {
+            if (remap[v] != UNUSED_VERTEX)
+                memcpy(result.data() + remap[v] * stride, vertexData.data() + v * stride, stride);
+        }
+        vertexData.swap(result);
+    }
+
+    float computeOverfetch(const std::vector<uint32_t>& indices, size_t vertexCount, size_t stride) {
+        const size_t cacheLine = 64;
+        const size_t cacheLineCount = 128 * 1024 / cacheLine;
+
+        // Each slot holds the line address + 1 so 0 can mean empty
+        std::vector<size_t> cache(cacheLineCount, 0);
+        std::vector<bool> referenced(vertexCount, false);
+        size_t referencedCount = 0;
+        size_t bytesFetched = 0;
+        for (uint32_t index : indices) {
+            if (!referenced[index]) {
+                referenced[index] = true;
+                ++referencedCount;
+            }
+            size_t firstLine = index * stride / cacheLine;
+            size_t lastLine = ((size_t)index * stride + stride - 1) / cacheLine;
+            for (size_t line = firstLine; line <= lastLine; ++line) {
+                size_t& slot = cache[line % cacheLineCount];
+                if (slot != line + 1) {
+                    bytesFetched += cacheLine;
+                    slot = line + 1;
+                }
+            }
+        }
+
+        if (referencedCount == 0)
+            return 0.0f;
+        return (float)bytesFetched / (float)(referencedCount * stride);
+    }
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace TT_FBX {
+    // Size of the post-transform vertex cache we optimize for,
+    // this is a reasonable middle ground for most GPUs.
+    constexpr uint32_t VERTEX_CACHE_SIZE = 16;
+
+    // Vertex -> triangle adjacency of a triangle list, stored as one flat array with an offset per vertex.
+    struct TriangleAdjacency {
+        // Number of triangles referencing each vertex.
+        std::vector<uint32_t> counts;
+        // Triangles of vertex v are triangles[offsets[v]] up to triangles[offsets[v + 1]].
+        std::vector<uint32_t> offsets;
+        std::vector<uint32_t> triangles;
+    };
+
+    TriangleAdjacency buildTriangleAdjacency(const std::vector<uint32_t>& indices, size_t vertexCount);
+
+    // Reorder the triangles in a triangle list so consecutive triangles reuse recently transformed vertices.
+    // This implements Tipsify (Sander, Nehab & Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw").
+    void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount);
+
+    // Reorder clusters of triangles so that triangles likely to occlude others are drawn first.
+    // Expects a triangle list that has gone through optimizeVertexCache. The threshold is how much
+    // worse the average cache miss ratio may become in favor of smaller clusters (1.05 means 5% worse).
+    // The vertex data must start with a float3 position, as all our vertex layouts do.
+    void optimizeOverdraw(std::vector<uint32_t>& indices, const uint8_t* vertexData, size_t vertexCount, size_t stride, float threshold);
+
+    // Marks a vertex that is not referenced by the index buffer in a remap table.
+    constexpr uint32_t UNUSED_VERTEX = ~0u;
+
+    // Build a table that renumbers vertices in order of first use by the index buffer.
+    // Unreferenced vertices map to UNUSED_VERTEX. Returns the number of vertices that remain.
+    size_t buildVertexFetchRemap(const std::vector<uint32_t>& indices, size_t vertexCount, std::vector<uint32_t>& remap);
+
+    // Apply a remap table to an index buffer.
+    void remapIndices(std::vector<uint32_t>& indices, const std::vector<uint32_t>& remap);
+
+    // Apply a remap table to any per-vertex data, dropping unused vertices.
+    void remapVertices(std::vector<uint8_t>& vertexData, size_t stride, const std::vector<uint32_t>& remap, size_t newVertexCount);
+
+    // Bytes fetched from memory divided by the size of the referenced vertex data, 1.0 is optimal.
+    // This models a 64 byte cache line, direct mapped cache, which is a gross approximation but good enough to compare orderings.
+    float computeOverfetch(const std::vector<uint32_t>& indices, size_t vertexCount, size_t stride);
+}
@@ -1,11 +1,22 @@
 #include <fbxsdk.h>
 #include <vector>
 #include <map>
+#include <tuple>
 #include <unordered_map>
 #include <algorithm>
 
 #include "fbxLoader.h"
 #include "meshParser.h"
+#include "boundsBuilder.h"
+#include "bvhBuilder.h"
+#include "meshOptimizer.h"
+#include "meshletBuilder.h"
+#include "meshSimplifier.h"
+#include "morphTargetBuilder.h"
+#include "normalGenerator.h"
+#include "spillFile.h"
+#include "tangentGenerator.h"
+#include "vertexWelder.h"
 
 namespace {
     struct Vertex {
@@ -90,8 +101,52 @@ namespace {
         return element->GetDirectArray().GetAt(i);
     }
 
+    // Attributes generated per polygon vertex for meshes that lack them, empty when not generated.
+    struct GeneratedAttributes {
+        // 3 floats per polygon vertex.
+        std::vector<float> normals;
+        // 4 floats per polygon vertex.
+        std::vector<float> tangents;
+    };
+
+    // Number of fbx layers of each kind that go into the vertex, the first layers of the mesh are used.
+    struct LayerCounts {
+        int normals = 0;
+        int tangents = 0;
+        int binormals = 0;
+        int uvs = 0;
+        int colors = 0;
+    };
+
+    // The most layers of a kind the settings allow, semanticRoom is how many the Semantic enum has space for.
+    inline int layerLimit(const MeshExtractSettings& settings, SemanticMask kind, uint32_t maxLayers, int semanticRoom) {
+        if (!((int)settings.semanticMask & (int)kind))
+            return 0;
+        return (int)std::min(maxLayers, (uint32_t)semanticRoom);
+    }
+
+    LayerCounts getLayerLimits(const MeshExtractSettings& settings) {
+        LayerCounts limits;
+        limits.normals = layerLimit(settings, SemanticMask::Normal, settings.maxNormalLayers, (int)Semantic::_Stride);
+        limits.tangents = layerLimit(settings, SemanticMask::Tangent, settings.maxTangentLayers, (int)Semantic::_Stride);
+        limits.binormals = layerLimit(settings, SemanticMask::Binormal, settings.maxBinormalLayers, (int)Semantic::_Stride);
+        limits.uvs = layerLimit(settings, SemanticMask::UV, settings.maxUvLayers, (int)Semantic::_Stride);
+        limits.colors = layerLimit(settings, SemanticMask::Color, settings.maxColorLayers, 255 - (int)Semantic::Color);
+        return limits;
+    }
+
+    LayerCounts getLayerCounts(const FbxMesh* mesh, const LayerCounts& limits) {
+        LayerCounts layers;
+        layers.normals = std::min(limits.normals, mesh->GetElementNormalCount());
+        layers.tangents = std::min(limits.tangents, mesh->GetElementTangentCount());
+        layers.binormals = std::min(limits.binormals, mesh->GetElementBinormalCount());
+        layers.uvs = std::min(limits.uvs, mesh->GetElementUVCount());
+        layers.colors = std::min(limits.colors, mesh->GetElementVertexColorCount());
+        return layers;
+    }
+
     // Get data for a single vertex, by reading each attribute in the mesh and filling the Vertex structure.
-    void getVertex(const FbxMesh* pMesh, size_t polygonIndex, size_t localVertexIndex, size_t globalVertexIndex, Vertex& vertexBuffer, const std::vector<std::vector<std::pair<int, double>>>& orderedSkinWeights) {
+    void getVertex(const FbxMesh* pMesh, size_t polygonIndex, size_t localVertexIndex, size_t globalVertexIndex, Vertex& vertexBuffer, const std::vector<std::vector<std::pair<int, double>>>& orderedSkinWeights, const LayerCounts& layers, const GeneratedAttributes& generated) {
         // Reset the vertex buffer.
         vertexBuffer.cursor = 0;
 
@@ -131,19 +186,29 @@ namespace {
         // FbxMesh::GetElementNormalCount, FbxMesh::GetElementNormal, Vertex::setVec3
 
         // Finally, append each attribute in the mesh to the vertex buffer.
-        for (size_t x = 0; x < std::min((int)Semantic::_Stride, pMesh->GetElementNormalCount()); ++x)
+        for (int x = 0; x < layers.normals; ++x)
             vertexBuffer.setVec3(getVertexAttributeValue(controlPointIndex, pMesh, pMesh->GetElementNormal((int)x), polygonIndex, globalVertexIndex));
 
-        for (size_t x = 0; x < std::min((int)Semantic::_Stride, pMesh->GetElementTangentCount()); ++x)
+        if (!generated.normals.empty()) {
+            for (size_t x = 0; x < 3; ++x)
+                vertexBuffer.setFloat(generated.normals[globalVertexIndex * 3 + x]);
+        }
+
+        for (int x = 0; x < layers.tangents; ++x)
             vertexBuffer.setVec3(getVertexAttributeValue(controlPointIndex, pMesh, pMesh->GetElementTangent((int)x), polygonIndex, globalVertexIndex));
 
-        for (size_t x = 0; x < std::min((int)Semantic::_Stride, pMesh->GetElementBinormalCount()); ++x)
+        if (!generated.tangents.empty()) {
+            for (size_t x = 0; x < 4; ++x)
+                vertexBuffer.setFloat(generated.tangents[globalVertexIndex * 4 + x]);
+        }
+
+        for (int x = 0; x < layers.binormals; ++x)
             vertexBuffer.setVec3(getVertexAttributeValue(controlPointIndex, pMesh, pMesh->GetElementBinormal((int)x), polygonIndex, globalVertexIndex));
 
-        for (size_t x = 0; x < std::min((int)Semantic::_Stride, pMesh->GetElementUVCount()); ++x)
+        for (int x = 0; x < layers.uvs; ++x)
             vertexBuffer.setVec2(getVertexAttributeValue(controlPointIndex, pMesh, pMesh->GetElementUV((int)x), polygonIndex, globalVertexIndex));
 
-        for (size_t x = 0; x < std::min(255 - (int)Semantic::Color, pMesh->GetElementVertexColorCount()); ++x)
+        for (int x = 0; x < layers.colors; ++x)
             vertexBuffer.setColor(getVertexAttributeValue(controlPointIndex, pMesh, pMesh->GetElementVertexColor((int)x), polygonIndex, globalVertexIndex));
     }
     
@@ -151,6 +216,15 @@ namespace {
         uint32_t materialId = 0;
         std::vector<unsigned char> vertexData;
         std::vector<uint32_t> indexData;
+        MeshStatistics statistics;
+        TT_FBX::MeshletBuffers meshlets;
+        TT_FBX::BvhBuffers bvh;
+        std::vector<TT_FBX::SimplifiedLod> lods;
+        std::vector<uint64_t> streamOffsets;
+        Bounds bounds;
+        // Polygon vertex each vertex was read from, only tracked when the mesh has blend shapes.
+        std::vector<uint32_t> sourceCorners;
+        std::vector<TT_FBX::MorphTargetBuffers> morphTargets;
     };
 
     template<typename K, typename V>
@@ -172,6 +246,8 @@ namespace {
         std::vector<std::vector<std::pair<int, double>>> orderedSkinWeights;
         // These indices map to the Node* array returned by processScene().
         std::vector<uint32_t> jointIdToNodeMap; 
+        // Per joint, transforms mesh space positions into the space of the joint at bind time.
+        std::vector<FbxAMatrix> meshToJoint;
     };
 
     // Get skin weights of the first skin in the mesh, result is empty if no skin.
@@ -193,6 +269,12 @@ namespace {
                 // TODO: Error if !link
                 result.jointIdToNodeMap.push_back(stack.Find(link));
 
+                FbxAMatrix meshBind;
+                FbxAMatrix jointBind;
+                lCluster->GetTransformMatrix(meshBind);
+                lCluster->GetTransformLinkMatrix(jointBind);
+                result.meshToJoint.push_back(jointBind.Inverse() * meshBind);
+
                 int vertexIndexCount = lCluster->GetControlPointIndicesCount();
                 for (int k = 0; k < vertexIndexCount; ++k) {
                     int vertexId = lCluster->GetControlPointIndices()[k];
@@ -216,7 +298,7 @@ namespace {
     }
 
     // Describe the contents of the vertex buffer based on the available fbx attributes.
-    inline std::vector<VertexAttribute> getMeshVertexLayout(const FbxMesh* mesh, bool isSkinned) {
+    inline std::vector<VertexAttribute> getMeshVertexLayout(const LayerCounts& layers, bool isSkinned, const GeneratedAttributes& generated) {
         std::vector<VertexAttribute> layout;
         layout.push_back({ Semantic::Position, NumElements::Vec3, ElementType::Float });
 
@@ -227,92 +309,919 @@ namespace {
             layout.push_back({ Semantic::SkinWeights1, NumElements::Vec4, ElementType::Float });
         }
 
-        for (int offset = 0; offset < std::min((int)Semantic::_Stride, mesh->GetElementNormalCount()); ++offset) 
+        for (int offset = 0; offset < layers.normals; ++offset)
             layout.push_back({ (Semantic)((int)Semantic::Normal + offset), NumElements::Vec3, ElementType::Float });
 
-        for (int offset = 0; offset < std::min((int)Semantic::_Stride, mesh->GetElementTangentCount()); ++offset) 
+        if (!generated.normals.empty())
+            layout.push_back({ Semantic::Normal, NumElements::Vec3, ElementType::Float });
+
+        for (int offset = 0; offset < layers.tangents; ++offset)
             layout.push_back({ (Semantic)((int)Semantic::Tangent + offset), NumElements::Vec3, ElementType::Float });
 
-        for (int offset = 0; offset < std::min((int)Semantic::_Stride, mesh->GetElementBinormalCount()); ++offset) 
+        // Generated tangents carry the bitangent sign in w
+        if (!generated.tangents.empty())
+            layout.push_back({ Semantic::Tangent, NumElements::Vec4, ElementType::Float });
+
+        for (int offset = 0; offset < layers.binormals; ++offset)
             layout.push_back({ (Semantic)((int)Semantic::Binormal + offset), NumElements::Vec3, ElementType::Float });
 
-        for (int offset = 0; offset < std::min((int)Semantic::_Stride, mesh->GetElementUVCount()); ++offset)
+        for (int offset = 0; offset < layers.uvs; ++offset)
             layout.push_back({ (Semantic)((int)Semantic::UV + offset), NumElements::Vec2, ElementType::Float });
 
-        for (int offset = 0; offset < std::min(255 - (int)Semantic::Color, mesh->GetElementVertexColorCount()); ++offset) 
+        for (int offset = 0; offset < layers.colors; ++offset)
             layout.push_back({ (Semantic)((int)Semantic::Color + offset), NumElements::Vec4, ElementType::Float });
 
         return layout;
     }
 
+    inline int attributeSize(const VertexAttribute& key) {
+        int elementSize = 0;
+        switch (key.elementType) {
+        case ElementType::Float:
+            elementSize = 4;
+            break;
+        case ElementType::UInt32:
+            elementSize = 4;
+            break;
+        default:
+            // TODO: Not implemented error.
+            __debugbreak();
+            break;
+        }
+        return elementSize * (int)key.numElements;
+    }
+
     inline int strideFromlayout(const std::vector<VertexAttribute>& layout) {
         int stride = 0;
-        for (const VertexAttribute& key : layout) {
-            int elementSize = 0;
-            switch (key.elementType) {
-            case ElementType::Float:
-                elementSize = 4;
+        for (const VertexAttribute& key : layout)
+            stride += attributeSize(key);
+        return stride;
+    }
+
+    // Byte offset of the given semantic in a vertex, or -1 if the layout does not contain it.
+    inline int offsetFromLayout(const std::vector<VertexAttribute>& layout, Semantic semantic) {
+        for (size_t i = 0; i < layout.size(); ++i) {
+            if (layout[i].semantic == semantic)
+                return strideFromlayout(std::vector<VertexAttribute>(layout.begin(), layout.begin() + i));
+        }
+        return -1;
+    }
+
+    // Fill in the stream, offset and stride of every attribute and return the number of streams.
+    uint32_t assignVertexStreams(std::vector<VertexAttribute>& layout, const MeshExtractSettings& settings) {
+        uint32_t streamCount = 1;
+        for (size_t i = 0; i < layout.size(); ++i) {
+            VertexAttribute& attribute = layout[i];
+            switch (settings.streamMode) {
+            case VertexStreamMode::PerAttribute:
+                attribute.stream = (uint8_t)std::min<size_t>(i, 255);
                 break;
-            case ElementType::UInt32:
-                elementSize = 4;
+            case VertexStreamMode::Grouped:
+                attribute.stream = settings.semanticStreams[(int)attribute.semantic];
                 break;
             default:
-                // TODO: Not implemented error.
-                __debugbreak();
+                attribute.stream = 0;
                 break;
             }
-            stride += elementSize * (int)key.numElements;
+            streamCount = std::max(streamCount, (uint32_t)attribute.stream + 1);
         }
-        return stride;
+
+        // Attributes keep their layout order within a stream
+        std::vector<uint32_t> strides(streamCount, 0);
+        for (VertexAttribute& attribute : layout) {
+            attribute.offset = strides[attribute.stream];
+            strides[attribute.stream] += attributeSize(attribute);
+        }
+        for (VertexAttribute& attribute : layout)
+            attribute.stride = strides[attribute.stream];
+        return streamCount;
+    }
+
+    // Read the polygon vertices with the first normal and uv set, the input for normal and tangent generation.
+    // The FBX arrays are read on a single thread, the SDK does not promise that concurrent reads are safe.
+    TT_FBX::CornerGeometry getCornerGeometry(const FbxMesh* mesh) {
+        TT_FBX::CornerGeometry geometry;
+        int polygonCount = mesh->GetPolygonCount();
+        geometry.polygonOffsets.resize(polygonCount + 1);
+        for (int polygonIndex = 0; polygonIndex < polygonCount; ++polygonIndex)
+            geometry.polygonOffsets[polygonIndex] = (uint32_t)mesh->GetPolygonVertexIndex(polygonIndex);
+        geometry.polygonOffsets[polygonCount] = (uint32_t)mesh->GetPolygonVertexCount();
+
+        size_t cornerCount = geometry.polygonOffsets[polygonCount];
+        const FbxGeometryElementNormal* normals = mesh->GetElementNormalCount() > 0 ? mesh->GetElementNormal(0) : nullptr;
+        const FbxGeometryElementUV* uvs = mesh->GetElementUVCount() > 0 ? mesh->GetElementUV(0) : nullptr;
+        geometry.controlPoints.resize(cornerCount);
+        geometry.positions.resize(cornerCount * 3);
+        if (normals)
+            geometry.normals.resize(cornerCount * 3);
+        if (uvs)
+            geometry.uvs.resize(cornerCount * 2);
+        for (int polygonIndex = 0; polygonIndex < polygonCount; ++polygonIndex) {
+            for (uint32_t corner = geometry.polygonOffsets[polygonIndex]; corner < geometry.polygonOffsets[polygonIndex + 1]; ++corner) {
+                int controlPointIndex = mesh->GetPolygonVertex(polygonIndex, (int)(corner - geometry.polygonOffsets[polygonIndex]));
+                geometry.controlPoints[corner] = (uint32_t)controlPointIndex;
+                FbxVector4 position = mesh->GetControlPointAt(controlPointIndex);
+                for (int i = 0; i < 3; ++i)
+                    geometry.positions[corner * 3 + i] = (float)position[i];
+                if (normals) {
+                    FbxVector4 normal = getVertexAttributeValue(controlPointIndex, mesh, normals, polygonIndex, corner);
+                    normal.Normalize();
+                    for (int i = 0; i < 3; ++i)
+                        geometry.normals[corner * 3 + i] = (float)normal[i];
+                }
+                if (uvs) {
+                    FbxVector2 uv = getVertexAttributeValue(controlPointIndex, mesh, uvs, polygonIndex, corner);
+                    geometry.uvs[corner * 2] = (float)uv[0];
+                    geometry.uvs[corner * 2 + 1] = (float)uv[1];
+                }
+            }
+        }
+        return geometry;
+    }
+
+    // Read the smoothing element, if any, as input for normal generation.
+    TT_FBX::NormalSmoothing getNormalSmoothing(const FbxMesh* mesh, const TT_FBX::CornerGeometry& geometry, float creaseAngle) {
+        TT_FBX::NormalSmoothing smoothing;
+        smoothing.creaseAngle = creaseAngle;
+        if (mesh->GetElementSmoothingCount() == 0)
+            return smoothing;
+
+        const FbxGeometryElementSmoothing* element = mesh->GetElementSmoothing(0);
+        size_t polygonCount = geometry.polygonOffsets.size() - 1;
+        if (element->GetMappingMode() == FbxGeometryElement::eByPolygon) {
+            // Smoothing groups
+            smoothing.polygonGroups.resize(polygonCount);
+            for (size_t polygonIndex = 0; polygonIndex < polygonCount; ++polygonIndex)
+                smoothing.polygonGroups[polygonIndex] = getVertexAttributeValue(0, mesh, element, polygonIndex, 0);
+        } else if (element->GetMappingMode() == FbxGeometryElement::eByEdge && mesh->GetMeshEdgeCount() > 0) {
+            // Soft edge flags, the edge lookup caches internally, which is why it is not const
+            FbxMesh* edgeMesh = const_cast<FbxMesh*>(mesh);
+            const FbxLayerElementArrayTemplate<int>& direct = element->GetDirectArray();
+            const FbxLayerElementArrayTemplate<int>& indices = element->GetIndexArray();
+            bool indexed = element->GetReferenceMode() == FbxLayerElement::eIndexToDirect;
+            smoothing.smoothEdges.resize(geometry.controlPoints.size());
+            edgeMesh->BeginGetMeshEdgeIndexForPolygon();
+            for (size_t polygonIndex = 0; polygonIndex < polygonCount; ++polygonIndex) {
+                for (uint32_t corner = geometry.polygonOffsets[polygonIndex]; corner < geometry.polygonOffsets[polygonIndex + 1]; ++corner) {
+                    int edge = edgeMesh->GetMeshEdgeIndexForPolygon((int)polygonIndex, (int)(corner - geometry.polygonOffsets[polygonIndex]));
+                    if (edge < 0)
+                        continue;
+                    smoothing.smoothEdges[corner] = direct.GetAt(indexed ? indices.GetAt(edge) : edge) != 0;
+                }
+            }
+            edgeMesh->EndGetMeshEdgeIndexForPolygon();
+        }
+        return smoothing;
     }
 
-    inline std::vector<std::string> getUvSetNames(const FbxMesh* mesh) {
+    inline std::vector<std::string> getUvSetNames(const FbxMesh* mesh, int uvCount) {
         std::vector<std::string> uvSetNames;
-        for (int i = 0; i < mesh->GetElementUVCount(); ++i)
+        for (int i = 0; i < uvCount; ++i)
             uvSetNames.emplace_back(mesh->GetElementUV(i)->GetName());
         return uvSetNames;
     }
 
-    String* makeStringList(const std::vector<std::string>& list) {
-        String* result = new String[list.size()];
-        int cursor = 0;
-        for (const std::string& text : list)
-            result[cursor++] = TT_FBX::makeString(text.c_str());
+    // Start of the given attribute in a vertex buffer laid out by assignVertexStreams, interleaved or not.
+    inline const uint8_t* attributeData(const ManagedMeshData& vertexOwner, const VertexAttribute& attribute) {
+        return vertexOwner.vertexData.data() + vertexOwner.streamOffsets[attribute.stream] + attribute.offset;
+    }
+
+    inline const VertexAttribute* findAttribute(const std::vector<VertexAttribute>& layout, Semantic semantic) {
+        for (const VertexAttribute& attribute : layout) {
+            if (attribute.semantic == semantic)
+                return &attribute;
+        }
+        return nullptr;
+    }
+
+    // Fill in the bounds of every submesh from its final vertex data and return the bounds of the whole mesh.
+    // With a shared vertex buffer each submesh only bounds the vertices its indices reference.
+    Bounds computeMeshBounds(std::vector<ManagedMeshData>& subMeshes, const ManagedMeshData* sharedMesh, const std::vector<VertexAttribute>& layout, int stride) {
+        const VertexAttribute& position = *findAttribute(layout, Semantic::Position);
+        TT_FBX::parallelFor(subMeshes.size(), [&](size_t i) {
+            ManagedMeshData& subMesh = subMeshes[i];
+            if (!sharedMesh) {
+                subMesh.bounds = TT_FBX::computeBounds({ { attributeData(subMesh, position), position.stride, subMesh.vertexData.size() / stride } });
+                return;
+            }
+            size_t vertexCount = sharedMesh->vertexData.size() / stride;
+            std::vector<bool> used(vertexCount, false);
+            std::vector<uint32_t> vertices;
+            for (uint32_t index : subMesh.indexData) {
+                if (!used[index]) {
+                    used[index] = true;
+                    vertices.push_back(index);
+                }
+            }
+            subMesh.bounds = TT_FBX::computeBounds({ { attributeData(*sharedMesh, position), position.stride, vertices.size(), vertices.data() } });
+        });
+
+        std::vector<TT_FBX::PositionSpan> spans;
+        if (sharedMesh) {
+            spans.push_back({ attributeData(*sharedMesh, position), position.stride, sharedMesh->vertexData.size() / stride });
+        } else {
+            for (const ManagedMeshData& subMesh : subMeshes)
+                spans.push_back({ attributeData(subMesh, position), position.stride, subMesh.vertexData.size() / stride });
+        }
+        return TT_FBX::computeBounds(spans);
+    }
+
+    // Bounds of the vertices influenced by each joint, in the bind space of that joint.
+    std::vector<Bounds> computeJointBounds(const std::vector<ManagedMeshData*>& vertexOwners, const std::vector<VertexAttribute>& layout, int stride, const std::vector<FbxAMatrix>& meshToJoint) {
+        const VertexAttribute* position = findAttribute(layout, Semantic::Position);
+        const VertexAttribute* indices[2] = { findAttribute(layout, Semantic::SkinIndices0), findAttribute(layout, Semantic::SkinIndices1) };
+        const VertexAttribute* weights[2] = { findAttribute(layout, Semantic::SkinWeights0), findAttribute(layout, Semantic::SkinWeights1) };
+
+        // Gather the bind space positions per joint
+        std::vector<std::vector<float>> jointPositions(meshToJoint.size());
+        for (const ManagedMeshData* vertexOwner : vertexOwners) {
+            size_t vertexCount = vertexOwner->vertexData.size() / stride;
+            for (size_t vertex = 0; vertex < vertexCount; ++vertex) {
+                float p[3];
+                memcpy(p, attributeData(*vertexOwner, *position) + vertex * position->stride, sizeof(p));
+                for (int half = 0; half < 2; ++half) {
+                    uint32_t vertexJoints[4];
+                    float vertexWeights[4];
+                    memcpy(vertexJoints, attributeData(*vertexOwner, *indices[half]) + vertex * indices[half]->stride, sizeof(vertexJoints));
+                    memcpy(vertexWeights, attributeData(*vertexOwner, *weights[half]) + vertex * weights[half]->stride, sizeof(vertexWeights));
+                    for (int i = 0; i < 4; ++i) {
+                        if (vertexWeights[i] <= 0.0f || vertexJoints[i] >= meshToJoint.size())
+                            continue;
+                        FbxVector4 bindPosition = meshToJoint[vertexJoints[i]].MultT(FbxVector4(p[0], p[1], p[2], 1.0));
+                        std::vector<float>& target = jointPositions[vertexJoints[i]];
+                        target.push_back((float)bindPosition[0]);
+                        target.push_back((float)bindPosition[1]);
+                        target.push_back((float)bindPosition[2]);
+                    }
+                }
+            }
+        }
+
+        std::vector<Bounds> result(meshToJoint.size());
+        TT_FBX::parallelFor(result.size(), [&](size_t joint) {
+            const std::vector<float>& positions = jointPositions[joint];
+            result[joint] = TT_FBX::computeBounds({ { (const uint8_t*)positions.data(), sizeof(float) * 3, positions.size() / 3 } });
+        });
+        return result;
+    }
+
+    struct BlendShapeTarget {
+        std::string name;
+        const FbxShape* shape = nullptr;
+    };
+
+    // One target per blend shape channel, the one at full weight. In-between targets are not supported.
+    std::vector<BlendShapeTarget> getBlendShapeTargets(const FbxMesh* mesh) {
+        std::vector<BlendShapeTarget> result;
+        for (int i = 0; i < mesh->GetDeformerCount(FbxDeformer::eBlendShape); ++i) {
+            const FbxBlendShape* blendShape = (const FbxBlendShape*)mesh->GetDeformer(i, FbxDeformer::eBlendShape);
+            for (int channelIndex = 0; channelIndex < blendShape->GetBlendShapeChannelCount(); ++channelIndex) {
+                const FbxBlendShapeChannel* channel = blendShape->GetBlendShapeChannel(channelIndex);
+                // Targets are sorted by ascending full weight, the last one is the fully applied shape
+                int targetCount = channel->GetTargetShapeCount();
+                if (targetCount == 0)
+                    continue;
+                result.push_back({ channel->GetName(), channel->GetTargetShape(targetCount - 1) });
+            }
+        }
         return result;
     }
 
-    MeshData* flattenValues(const std::unordered_map<size_t, ManagedMeshData>& subMeshByMaterial) {
-        MeshData* result = new MeshData[subMeshByMaterial.size()];
+    // Read the deltas of a target relative to the mesh, corners hold the control point and polygon of every polygon vertex.
+    TT_FBX::MorphSource getMorphSource(const FbxMesh* mesh, const FbxShape* shape, const std::vector<uint32_t>& cornerControlPoints, const std::vector<uint32_t>& cornerPolygons) {
+        TT_FBX::MorphSource source;
+        int controlPointCount = std::min(mesh->GetControlPointsCount(), shape->GetControlPointsCount());
+        const FbxVector4* basePositions = mesh->GetControlPoints();
+        const FbxVector4* targetPositions = shape->GetControlPoints();
+        source.positionDeltas.resize(controlPointCount * 3);
+        for (int controlPoint = 0; controlPoint < controlPointCount; ++controlPoint) {
+            for (int i = 0; i < 3; ++i)
+                source.positionDeltas[controlPoint * 3 + i] = (float)(targetPositions[controlPoint][i] - basePositions[controlPoint][i]);
+        }
+
+        if (shape->GetElementNormalCount() == 0)
+            return source;
+        const FbxGeometryElementNormal* normals = shape->GetElementNormal(0);
+        source.normals.resize(cornerControlPoints.size() * 3);
+        for (size_t corner = 0; corner < cornerControlPoints.size(); ++corner) {
+            FbxVector4 normal = getVertexAttributeValue((int)cornerControlPoints[corner], mesh, normals, cornerPolygons[corner], corner);
+            normal.Normalize();
+            for (int i = 0; i < 3; ++i)
+                source.normals[corner * 3 + i] = (float)normal[i];
+        }
+        return source;
+    }
+
+    // Build the sparse deltas of every target for every vertex buffer, one target at a time so only one is ever read into memory.
+    void buildMorphTargets(const FbxMesh* mesh, const std::vector<BlendShapeTarget>& targets, const std::vector<ManagedMeshData*>& vertexOwners, const std::vector<VertexAttribute>& layout, bool quantize) {
+        if (targets.empty())
+            return;
+        int polygonCount = mesh->GetPolygonCount();
+        std::vector<uint32_t> cornerControlPoints(mesh->GetPolygonVertexCount());
+        std::vector<uint32_t> cornerPolygons(cornerControlPoints.size());
+        for (int polygonIndex = 0; polygonIndex < polygonCount; ++polygonIndex) {
+            int first = mesh->GetPolygonVertexIndex(polygonIndex);
+            for (int i = 0; i < mesh->GetPolygonSize(polygonIndex); ++i) {
+                cornerControlPoints[first + i] = (uint32_t)mesh->GetPolygonVertex(polygonIndex, i);
+                cornerPolygons[first + i] = (uint32_t)polygonIndex;
+            }
+        }
+
+        const VertexAttribute* normal = findAttribute(layout, Semantic::Normal);
+        for (ManagedMeshData* vertexOwner : vertexOwners)
+            vertexOwner->morphTargets.resize(targets.size());
+        for (size_t target = 0; target < targets.size(); ++target) {
+            TT_FBX::MorphSource source = getMorphSource(mesh, targets[target].shape, cornerControlPoints, cornerPolygons);
+            TT_FBX::parallelFor(vertexOwners.size(), [&](size_t i) {
+                ManagedMeshData& vertexOwner = *vertexOwners[i];
+                TT_FBX::MorphBase base;
+                base.vertexCount = vertexOwner.sourceCorners.size();
+                base.sourceCorners = vertexOwner.sourceCorners.data();
+                base.cornerControlPoints = cornerControlPoints.data();
+                if (normal) {
+                    base.normals = attributeData(vertexOwner, *normal);
+                    base.normalStride = normal->stride;
+                }
+                vertexOwner.morphTargets[target] = TT_FBX::buildMorphTarget(source, base, quantize);
+            });
+        }
+    }
+
+    // Hand the morph target buffers over to the arena.
+    MorphTarget* flattenMorphTargets(std::vector<TT_FBX::MorphTargetBuffers>& morphTargets, TT_FBX::Arena& arena) {
+        MorphTarget* result = arena.allocate<MorphTarget>(morphTargets.size());
+        for (size_t i = 0; i < morphTargets.size(); ++i) {
+            TT_FBX::MorphTargetBuffers& buffers = morphTargets[i];
+            MorphTarget& element = result[i];
+            element.deltaCount = (uint32_t)buffers.vertices.size();
+            element.vertices = arena.adopt(std::move(buffers.vertices));
+            element.positionDeltas = arena.adopt(std::move(buffers.positionDeltas));
+            element.normalDeltas = arena.adopt(std::move(buffers.normalDeltas));
+            element.quantizedPositionDeltas = arena.adopt(std::move(buffers.quantizedPositionDeltas));
+            element.quantizedNormalDeltas = arena.adopt(std::move(buffers.quantizedNormalDeltas));
+            element.positionScale = buffers.positionScale;
+            element.normalScale = buffers.normalScale;
+        }
+        return result;
+    }
+
+    template<typename T>
+    void addElement(TT_FBX::ContentHash& hash, const FbxLayerElementTemplate<T>* element) {
+        hash.add(element->GetMappingMode());
+        hash.add(element->GetReferenceMode());
+        const FbxLayerElementArrayTemplate<T>& direct = element->GetDirectArray();
+        hash.add(direct.GetCount());
+        // The FBX vector and color types have copy constructors but are plain doubles underneath
+        for (int i = 0; i < direct.GetCount(); ++i) {
+            T value = direct.GetAt(i);
+            hash.addBytes(&value, sizeof(T));
+        }
+        if (element->GetReferenceMode() == FbxLayerElement::eDirect)
+            return;
+        const FbxLayerElementArrayTemplate<int>& indices = element->GetIndexArray();
+        hash.add(indices.GetCount());
+        for (int i = 0; i < indices.GetCount(); ++i)
+            hash.add(indices.GetAt(i));
+    }
+
+    // Hash everything extractMesh reads from a mesh, except its deformers.
+    uint64_t hashMeshGeometry(const FbxMesh* mesh) {
+        TT_FBX::ContentHash hash;
+        hash.addBytes(mesh->GetControlPoints(), sizeof(FbxVector4) * mesh->GetControlPointsCount());
+        hash.addBytes(mesh->GetPolygonVertices(), sizeof(int) * mesh->GetPolygonVertexCount());
+        for (int polygonIndex = 0; polygonIndex < mesh->GetPolygonCount(); ++polygonIndex)
+            hash.add(mesh->GetPolygonSize(polygonIndex));
+
+        for (int i = 0; i < mesh->GetElementNormalCount(); ++i)
+            addElement(hash, mesh->GetElementNormal(i));
+        for (int i = 0; i < mesh->GetElementTangentCount(); ++i)
+            addElement(hash, mesh->GetElementTangent(i));
+        for (int i = 0; i < mesh->GetElementBinormalCount(); ++i)
+            addElement(hash, mesh->GetElementBinormal(i));
+        for (int i = 0; i < mesh->GetElementUVCount(); ++i) {
+            const FbxGeometryElementUV* uvs = mesh->GetElementUV(i);
+            hash.addBytes(uvs->GetName(), strlen(uvs->GetName()) + 1);
+            addElement(hash, uvs);
+        }
+        for (int i = 0; i < mesh->GetElementVertexColorCount(); ++i)
+            addElement(hash, mesh->GetElementVertexColor(i));
+        for (int i = 0; i < mesh->GetElementMaterialCount(); ++i)
+            addElement(hash, mesh->GetElementMaterial(i));
+        for (int i = 0; i < mesh->GetElementSmoothingCount(); ++i)
+            addElement(hash, mesh->GetElementSmoothing(i));
+        return hash.value();
+    }
+
+    // Polygons grouped by the submesh they belong to. Submeshes are numbered in order of first use,
+    // polygons of submesh i are polygons[offsets[i]] up to polygons[offsets[i + 1]].
+    struct PolygonsByMaterial {
+        std::vector<std::string> materialNames;
+        std::vector<uint32_t> offsets;
+        std::vector<int> polygons;
+    };
+
+    // Resolve the material slots of the node to submeshes once and counting sort the polygons by submesh,
+    // so the hot loop never looks at materials. Slots that share a material name share a submesh.
+    PolygonsByMaterial groupPolygonsByMaterial(const FbxMesh* mesh, const FbxNode* owner) {
+        PolygonsByMaterial result;
+        constexpr uint32_t UNASSIGNED = ~0u;
+
+        // A node without materials still gets a single submesh.
+        int slotCount = std::max(owner->GetMaterialCount(), 1);
+        std::vector<uint32_t> slotSubMesh(slotCount, UNASSIGNED);
+        std::unordered_map<std::string, uint32_t> subMeshByName;
+        auto resolveSlot = [&](int slot) {
+            if (slot < 0 || slot >= slotCount)
+                slot = 0;
+            uint32_t& subMesh = slotSubMesh[slot];
+            if (subMesh == UNASSIGNED) {
+                const FbxSurfaceMaterial* material = owner->GetMaterial(slot);
+                std::string name = material ? material->GetName() : "";
+                auto it = subMeshByName.find(name);
+                if (it == subMeshByName.end()) {
+                    it = subMeshByName.emplace(name, (uint32_t)result.materialNames.size()).first;
+                    result.materialNames.push_back(name);
+                }
+                subMesh = it->second;
+            }
+            return subMesh;
+        };
+
+        // We only support polygons with a surface area
+        int polygonCount = mesh->GetPolygonCount();
+        std::vector<int> validPolygons;
+        validPolygons.reserve(polygonCount);
+        for (int polygonIndex = 0; polygonIndex < polygonCount; ++polygonIndex) {
+            if (mesh->GetPolygonSize(polygonIndex) >= 3)
+                validPolygons.push_back(polygonIndex);
+        }
+        if (validPolygons.empty()) {
+            result.offsets.push_back(0);
+            return result;
+        }
+
+        const FbxGeometryElementMaterial* element = mesh->GetElementMaterialCount() > 0 ? mesh->GetElementMaterial() : nullptr;
+        if (!element || element->GetMappingMode() != FbxGeometryElement::eByPolygon) {
+            // eAllSame, or no material element at all, everything goes into a single submesh in the original order
+            const FbxLayerElementArrayTemplate<int>* indices = element ? &element->GetIndexArray() : nullptr;
+            resolveSlot(indices && indices->GetCount() > 0 ? indices->GetAt(0) : 0);
+            result.offsets = { 0, (uint32_t)validPolygons.size() };
+            result.polygons = std::move(validPolygons);
+            return result;
+        }
+
+        // eByPolygon, one lookup in a small table per polygon
+        const FbxLayerElementArrayTemplate<int>& indices = element->GetIndexArray();
+        std::vector<uint32_t> polygonSubMesh(validPolygons.size());
+        for (size_t i = 0; i < validPolygons.size(); ++i)
+            polygonSubMesh[i] = resolveSlot(indices.GetAt(validPolygons[i]));
+
+        // Counting sort, keeps the original polygon order within a submesh
+        result.offsets.assign(result.materialNames.size() + 1, 0);
+        for (uint32_t subMesh : polygonSubMesh)
+            result.offsets[subMesh + 1]++;
+        for (size_t i = 1; i < result.offsets.size(); ++i)
+            result.offsets[i] += result.offsets[i - 1];
+        std::vector<uint32_t> cursors(result.offsets.begin(), result.offsets.end() - 1);
+        result.polygons.resize(validPolygons.size());
+        for (size_t i = 0; i < validPolygons.size(); ++i)
+            result.polygons[cursors[polygonSubMesh[i]]++] = validPolygons[i];
+        return result;
+    }
+
+    // Hand the submesh buffers over to the arena. Large buffers are moved rather than copied,
+    // so the submeshes are left empty afterwards.
+    // With a sharedMesh the submeshes are concatenated into its index buffer instead, the caller hands that over.
+    // Vertex and index buffers go through the budget, which may move them to disk.
+    MeshData* flattenValues(std::vector<ManagedMeshData>& subMeshByMaterial, int stride, ManagedMeshData* sharedMesh, TT_FBX::Arena& arena, TT_FBX::BufferBudget& budget) {
+        MeshData* result = arena.allocate<MeshData>(subMeshByMaterial.size());
+        if (sharedMesh) {
+            size_t indexCount = 0;
+            for (const ManagedMeshData& subMesh : subMeshByMaterial)
+                indexCount += subMesh.indexData.size();
+            sharedMesh->indexData.reserve(indexCount);
+        }
+
         size_t cursor = 0;
-        for (const auto& pair : subMeshByMaterial) {
+        for (ManagedMeshData& subMesh : subMeshByMaterial) {
             MeshData& element = result[cursor];
-            element.materialId = pair.second.materialId;
-
-            element.vertexDataSizeInBytes = (unsigned int)pair.second.vertexData.size();
-            element.vertexDataBlob = new unsigned char[element.vertexDataSizeInBytes];
-            memcpy(element.vertexDataBlob, pair.second.vertexData.data(), element.vertexDataSizeInBytes);
+            element.materialId = subMesh.materialId;
+            element.indexCount = (uint32_t)subMesh.indexData.size();
+
+            if (sharedMesh) {
+                // Indices are stored relative to the lowest vertex the submesh uses, to keep them small
+                element.firstIndex = (uint32_t)sharedMesh->indexData.size();
+                if (!subMesh.indexData.empty())
+                    element.baseVertex = *std::min_element(subMesh.indexData.begin(), subMesh.indexData.end());
+                for (uint32_t index : subMesh.indexData)
+                    sharedMesh->indexData.push_back(index - element.baseVertex);
+                std::vector<uint32_t>().swap(subMesh.indexData);
+            } else {
+                element.vertexDataSizeInBytes = subMesh.vertexData.size();
+                element.vertexDataBlob = budget.adopt(std::move(subMesh.vertexData));
+
+                element.indexDataSizeInBytes = subMesh.indexData.size() * sizeof(uint32_t);
+                element.indexDataBlob = (unsigned char*)budget.adopt(std::move(subMesh.indexData));
+
+                element.vertexCount = (uint32_t)(element.vertexDataSizeInBytes / stride);
+                element.streamOffsets = arena.flattenList(subMesh.streamOffsets);
+            }
 
-            element.indexDataSizeInBytes = (unsigned int)pair.second.indexData.size() * sizeof(unsigned int);
-            element.indexDataBlob = new unsigned char[element.indexDataSizeInBytes];
-            memcpy(element.indexDataBlob, pair.second.indexData.data(), element.indexDataSizeInBytes);
+            element.statistics = subMesh.statistics;
+            element.bounds = subMesh.bounds;
+            element.morphTargetCount = (uint32_t)subMesh.morphTargets.size();
+            element.morphTargets = flattenMorphTargets(subMesh.morphTargets, arena);
+
+            element.meshletCount = (uint32_t)subMesh.meshlets.meshlets.size();
+            element.meshlets = arena.adopt(std::move(subMesh.meshlets.meshlets));
+            element.meshletVertexCount = (uint32_t)subMesh.meshlets.vertices.size();
+            element.meshletVertices = arena.adopt(std::move(subMesh.meshlets.vertices));
+            element.meshletTriangleCount = (uint32_t)subMesh.meshlets.triangles.size();
+            element.meshletTriangles = arena.adopt(std::move(subMesh.meshlets.triangles));
+
+            element.bvhNodeCount = (uint32_t)subMesh.bvh.nodes.size();
+            element.bvhNodes = arena.adopt(std::move(subMesh.bvh.nodes));
+            element.bvhTriangleCount = (uint32_t)subMesh.bvh.triangles.size();
+            element.bvhTriangles = arena.adopt(std::move(subMesh.bvh.triangles));
+
+            // All LODs are concatenated into one index array, each LOD is released as soon as it is copied
+            size_t lodIndexCount = 0;
+            for (const TT_FBX::SimplifiedLod& lod : subMesh.lods)
+                lodIndexCount += lod.indices.size();
+            element.lodCount = (uint32_t)subMesh.lods.size();
+            element.lods = arena.allocate<MeshLod>(element.lodCount);
+            element.lodIndexCount = (uint32_t)lodIndexCount;
+            element.lodIndices = arena.allocate<uint32_t>(lodIndexCount);
+            uint32_t lodCursor = 0;
+            for (uint32_t i = 0; i < element.lodCount; ++i) {
+                TT_FBX::SimplifiedLod& lod = subMesh.lods[i];
+                element.lods[i] = { lodCursor, (uint32_t)lod.indices.size(), lod.error };
+                for (size_t j = 0; j < lod.indices.size(); ++j)
+                    element.lodIndices[lodCursor + j] = lod.indices[j] - element.baseVertex;
+                lodCursor += (uint32_t)lod.indices.size();
+                std::vector<uint32_t>().swap(lod.indices);
+            }
 
             cursor++;
         }
         return result;
     }
 
-    // Read a single mesh and return a multi-mesh with submeshes split up by material.
-    MultiMeshData extractMesh(const FbxMesh* mesh, const FbxArray<FbxNode*>& stack) {
-        const FbxNode* owner = mesh->GetNode();
-        if (!owner) return {};
+    // Split interleaved vertices into the streams assigned by assignVertexStreams, stored back to back.
+    void splitVertexStreams(ManagedMeshData& subMesh, const std::vector<VertexAttribute>& layout, int stride, uint32_t streamCount) {
+        size_t vertexCount = subMesh.vertexData.size() / stride;
+        subMesh.streamOffsets.assign(streamCount, 0);
+        if (streamCount == 1)
+            return;
+
+        std::vector<uint32_t> strides(streamCount, 0);
+        for (const VertexAttribute& attribute : layout)
+            strides[attribute.stream] = attribute.stride;
+        uint64_t cursor = 0;
+        for (uint32_t i = 0; i < streamCount; ++i) {
+            subMesh.streamOffsets[i] = cursor;
+            cursor += strides[i] * (uint64_t)vertexCount;
+        }
+
+        std::vector<unsigned char> streams(subMesh.vertexData.size());
+        int sourceOffset = 0;
+        for (const VertexAttribute& attribute : layout) {
+            int size = attributeSize(attribute);
+            const unsigned char* source = subMesh.vertexData.data() + sourceOffset;
+            unsigned char* target = streams.data() + subMesh.streamOffsets[attribute.stream] + attribute.offset;
+            for (size_t i = 0; i < vertexCount; ++i)
+                memcpy(target + i * attribute.stride, source + i * stride, size);
+            sourceOffset += size;
+        }
+        subMesh.vertexData.swap(streams);
+    }
+
+    // Triangle order stages and LODs. These only reorder and add indices, so they also work on a range of a shared vertex buffer.
+    void optimizeTriangles(ManagedMeshData& subMesh, const unsigned char* vertexData, size_t vertexCount, const std::vector<VertexAttribute>& layout, int stride, const MeshExtractSettings& settings) {
+        // Overdraw optimization works on clusters found in the cache optimized triangle order.
+        bool optimizeOverdraw = (int)settings.flags & (int)MeshExtractFlags::OptimizeOverdraw;
+        bool optimizeVertexCache = optimizeOverdraw || ((int)settings.flags & (int)MeshExtractFlags::OptimizeVertexCache);
+        if (optimizeVertexCache)
+            TT_FBX::optimizeVertexCache(subMesh.indexData, vertexCount);
+
+        if (optimizeOverdraw)
+            TT_FBX::optimizeOverdraw(subMesh.indexData, vertexData, vertexCount, stride, settings.overdrawThreshold);
+
+        // LODs are simplified from the full detail mesh and share its vertices.
+        if (settings.lodCount > 0) {
+            std::vector<TT_FBX::LodTarget> targets;
+            for (uint32_t i = 0; i < std::min(settings.lodCount, MAX_LOD_COUNT); ++i)
+                targets.push_back({ settings.lodTargetRatios[i], settings.lodTargetErrors[i] });
+            subMesh.lods = TT_FBX::buildLods(subMesh.indexData, vertexData, vertexCount, stride, offsetFromLayout(layout, Semantic::SkinIndices0), targets);
+            if (optimizeVertexCache) {
+                for (TT_FBX::SimplifiedLod& lod : subMesh.lods)
+                    TT_FBX::optimizeVertexCache(lod.indices, vertexCount);
+            }
+        }
+    }
+
+    // A compact copy of the vertices of a shared vertex buffer that a submesh uses. The optimizers and the meshlet builder keep
+    // scratch per vertex, so they get this instead of the shared buffer, otherwise every submesh would pay for all of it.
+    struct CompactVertices {
+        // Shared vertex of every compact vertex, in increasing order.
+        std::vector<uint32_t> used;
+        std::vector<unsigned char> vertexData;
+        // The indices, renumbered to compact vertices.
+        std::vector<uint32_t> indices;
+    };
+
+    CompactVertices compactVertices(const std::vector<uint32_t>& indices, const ManagedMeshData& sharedMesh, int stride) {
+        CompactVertices compact;
+        compact.used = indices;
+        std::sort(compact.used.begin(), compact.used.end());
+        compact.used.erase(std::unique(compact.used.begin(), compact.used.end()), compact.used.end());
+        compact.vertexData.resize(compact.used.size() * stride);
+        for (size_t i = 0; i < compact.used.size(); ++i)
+            memcpy(compact.vertexData.data() + i * stride, sharedMesh.vertexData.data() + (size_t)compact.used[i] * stride, stride);
+
+        compact.indices.resize(indices.size());
+        for (size_t i = 0; i < indices.size(); ++i)
+            compact.indices[i] = (uint32_t)(std::lower_bound(compact.used.begin(), compact.used.end(), indices[i]) - compact.used.begin());
+        return compact;
+    }
+
+    // optimizeTriangles for a submesh of a shared vertex buffer.
+    void optimizeSharedTriangles(ManagedMeshData& subMesh, const ManagedMeshData& sharedMesh, const std::vector<VertexAttribute>& layout, int stride, const MeshExtractSettings& settings) {
+        int triangleStages = (int)MeshExtractFlags::OptimizeVertexCache | (int)MeshExtractFlags::OptimizeOverdraw;
+        if (!((int)settings.flags & triangleStages) && settings.lodCount == 0)
+            return;
+
+        CompactVertices compact = compactVertices(subMesh.indexData, sharedMesh, stride);
+        subMesh.indexData.swap(compact.indices);
+        optimizeTriangles(subMesh, compact.vertexData.data(), compact.used.size(), layout, stride, settings);
+        for (uint32_t& index : subMesh.indexData)
+            index = compact.used[index];
+        for (TT_FBX::SimplifiedLod& lod : subMesh.lods) {
+            for (uint32_t& index : lod.indices)
+                index = compact.used[index];
+        }
+    }
+
+    // buildMeshlets for a submesh of a shared vertex buffer, the meshlet vertices point into the shared buffer.
+    TT_FBX::MeshletBuffers buildSharedMeshlets(const ManagedMeshData& subMesh, const ManagedMeshData& sharedMesh, int stride, const MeshExtractSettings& settings) {
+        CompactVertices compact = compactVertices(subMesh.indexData, sharedMesh, stride);
+        TT_FBX::MeshletBuffers meshlets = TT_FBX::buildMeshlets(compact.indices, compact.vertexData.data(), compact.used.size(), stride, settings.maxMeshletVertices, settings.maxMeshletTriangles);
+        for (uint32_t& vertex : meshlets.vertices)
+            vertex = compact.used[vertex];
+        return meshlets;
+    }
+
+    // Renumber the vertices in the order the submeshes use them, in submesh order, and drop unreferenced vertices.
+    void optimizeVertexFetch(ManagedMeshData& vertexOwner, const std::vector<ManagedMeshData*>& subMeshes, int stride, MeshStatistics& statistics) {
+        size_t vertexCount = vertexOwner.vertexData.size() / stride;
+        std::vector<uint32_t> indices;
+        for (const ManagedMeshData* subMesh : subMeshes)
+            indices.insert(indices.end(), subMesh->indexData.begin(), subMesh->indexData.end());
+        statistics.overfetchBefore = TT_FBX::computeOverfetch(indices, vertexCount, stride);
+
+        std::vector<uint32_t> remap;
+        size_t usedVertexCount = TT_FBX::buildVertexFetchRemap(indices, vertexCount, remap);
+        TT_FBX::remapIndices(indices, remap);
+        for (ManagedMeshData* subMesh : subMeshes) {
+            TT_FBX::remapIndices(subMesh->indexData, remap);
+            // LODs only use a subset of the full detail vertices, so they never reference a removed vertex.
+            for (TT_FBX::SimplifiedLod& lod : subMesh->lods)
+                TT_FBX::remapIndices(lod.indices, remap);
+        }
+        TT_FBX::remapVertices(vertexOwner.vertexData, stride, remap, usedVertexCount);
+        if (!vertexOwner.sourceCorners.empty()) {
+            std::vector<uint32_t> sourceCorners(usedVertexCount);
+            for (size_t v = 0; v < remap.size(); ++v) {
+                if (remap[v] != TT_FBX::UNUSED_VERTEX)
+                    sourceCorners[remap[v]] = vertexOwner.sourceCorners[v];
+            }
+            vertexOwner.sourceCorners.swap(sourceCorners);
+        }
+
+        statistics.unusedVerticesRemoved = (uint32_t)(vertexCount - usedVertexCount);
+        statistics.overfetchAfter = TT_FBX::computeOverfetch(indices, usedVertexCount, stride);
+    }
+
+    // Merge vertices within the weld tolerances, users are the submeshes that index the vertex buffer of vertexOwner.
+    void weldVertices(ManagedMeshData& vertexOwner, const std::vector<ManagedMeshData*>& users, const FbxMesh* mesh, const std::vector<VertexAttribute>& layout, int stride, const MeshExtractSettings& settings) {
+        std::vector<TT_FBX::WeldAttribute> attributes;
+        uint32_t offset = 0;
+        for (const VertexAttribute& attribute : layout) {
+            TT_FBX::WeldCompare compare = TT_FBX::WeldCompare::Absolute;
+            if (attribute.semantic == Semantic::Position)
+                compare = TT_FBX::WeldCompare::Distance;
+            else if (attribute.elementType == ElementType::UInt32)
+                compare = TT_FBX::WeldCompare::Exact;
+            else if ((int)attribute.semantic >= (int)Semantic::Normal && (int)attribute.semantic < (int)Semantic::UV)
+                compare = TT_FBX::WeldCompare::Angle;
+            attributes.push_back({ offset, (uint32_t)attribute.numElements, compare });
+            offset += attributeSize(attribute);
+        }
+
+        TT_FBX::WeldTolerance tolerance;
+        tolerance.position = settings.weldPositionEpsilon;
+        tolerance.normalCosine = cosf(settings.weldNormalAngle * 3.14159265f / 180.0f);
+        tolerance.absolute = settings.weldUvEpsilon;
+
+        // Morph targets move control points independently, so their vertices must stay apart.
+        std::vector<uint32_t> controlPoints;
+        if (!vertexOwner.sourceCorners.empty()) {
+            const int* polygonVertices = mesh->GetPolygonVertices();
+            controlPoints.reserve(vertexOwner.sourceCorners.size());
+            for (uint32_t corner : vertexOwner.sourceCorners)
+                controlPoints.push_back((uint32_t)polygonVertices[corner]);
+        }
+
+        std::vector<uint32_t> remap;
+        size_t welded = TT_FBX::weldVertices(vertexOwner.vertexData, stride, attributes, tolerance, controlPoints.empty() ? nullptr : controlPoints.data(), remap);
+        // Triangles that had two corners welded together collapsed, they are dropped.
+        vertexOwner.statistics.verticesWelded = (uint32_t)welded;
+        for (ManagedMeshData* user : users) {
+            std::vector<uint32_t>& indices = user->indexData;
+            TT_FBX::remapIndices(indices, remap);
+            size_t kept = 0;
+            for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+                if (indices[i] == indices[i + 1] || indices[i + 1] == indices[i + 2] || indices[i + 2] == indices[i])
+                    continue;
+                indices[kept++] = indices[i];
+                indices[kept++] = indices[i + 1];
+                indices[kept++] = indices[i + 2];
+            }
+            indices.resize(kept);
+            user->statistics.verticesWelded = (uint32_t)welded;
+        }
+
+        // The first vertex of every group is the one that was kept, it keeps its source corner.
+        if (!vertexOwner.sourceCorners.empty()) {
+            uint32_t cursor = 0;
+            for (size_t v = 0; v < remap.size(); ++v) {
+                if (remap[v] == cursor)
+                    vertexOwner.sourceCorners[cursor++] = vertexOwner.sourceCorners[v];
+            }
+            vertexOwner.sourceCorners.resize(cursor);
+        }
+    }
+
+    // Run the optional processing stages on a fully deduplicated submesh.
+    void optimizeSubMesh(ManagedMeshData& subMesh, const std::vector<VertexAttribute>& layout, int stride, uint32_t streamCount, const MeshExtractSettings& settings) {
+        optimizeTriangles(subMesh, subMesh.vertexData.data(), subMesh.vertexData.size() / stride, layout, stride, settings);
+
+        // Reordering triangles scatters vertex reads, so this must run after all triangle stages.
+        if ((int)settings.flags & (int)MeshExtractFlags::OptimizeVertexFetch)
+            optimizeVertexFetch(subMesh, { &subMesh }, stride, subMesh.statistics);
+
+        // Meshlets reference the final buffers, so they are built after all reordering.
+        if ((int)settings.flags & (int)MeshExtractFlags::BuildMeshlets)
+            subMesh.meshlets = TT_FBX::buildMeshlets(subMesh.indexData, subMesh.vertexData.data(), subMesh.vertexData.size() / stride, stride, settings.maxMeshletVertices, settings.maxMeshletTriangles);
+
+        // Positions come first in the layout, so the BVH reads them from the interleaved vertices before they are split up.
+        if ((int)settings.flags & (int)MeshExtractFlags::BuildBvh)
+            subMesh.bvh = TT_FBX::buildBvh(subMesh.indexData, subMesh.vertexData.data(), stride, settings.maxBvhLeafTriangles, settings.bvhBinCount);
+
+        // Everything above needs whole vertices, so streams are split up last.
+        splitVertexStreams(subMesh, layout, stride, streamCount);
+    }
+
+    // Same as optimizeSubMesh, but for submeshes that only have indices into the vertex buffer of sharedMesh.
+    void optimizeSharedMesh(ManagedMeshData& sharedMesh, const std::vector<ManagedMeshData*>& subMeshes, const std::vector<VertexAttribute>& layout, int stride, uint32_t streamCount, const MeshExtractSettings& settings) {
+        TT_FBX::parallelFor(subMeshes.size(), [&](size_t i) {
+            optimizeSharedTriangles(*subMeshes[i], sharedMesh, layout, stride, settings);
+        });
+
+        // The statistics describe the shared vertex buffer, so every submesh reports the same numbers.
+        if ((int)settings.flags & (int)MeshExtractFlags::OptimizeVertexFetch) {
+            optimizeVertexFetch(sharedMesh, subMeshes, stride, sharedMesh.statistics);
+            for (ManagedMeshData* subMesh : subMeshes)
+                subMesh->statistics = sharedMesh.statistics;
+        }
+
+        if ((int)settings.flags & (int)MeshExtractFlags::BuildMeshlets) {
+            TT_FBX::parallelFor(subMeshes.size(), [&](size_t i) {
+                subMeshes[i]->meshlets = buildSharedMeshlets(*subMeshes[i], sharedMesh, stride, settings);
+            });
+        }
+
+        if ((int)settings.flags & (int)MeshExtractFlags::BuildBvh) {
+            TT_FBX::parallelFor(subMeshes.size(), [&](size_t i) {
+                subMeshes[i]->bvh = TT_FBX::buildBvh(subMeshes[i]->indexData, sharedMesh.vertexData.data(), stride, settings.maxBvhLeafTriangles, settings.bvhBinCount);
+            });
+        }
+
+        splitVertexStreams(sharedMesh, layout, stride, streamCount);
+    }
+
+    // Part of every content hash, bump it when what hashSubMesh or hashMultiMesh cover changes so stored hashes stop matching.
+    constexpr uint32_t CONTENT_HASH_VERSION = 2;
+
+    template<typename T>
+    void addArray(TT_FBX::ContentHash& hash, const T* data, size_t count) {
+        hash.addBytes(data, sizeof(T) * count);
+    }
+
+    void addString(TT_FBX::ContentHash& hash, const String& text) {
+        hash.addBytes(text.buffer, text.length);
+    }
+
+    // Fields are added one at a time, struct padding is not part of the output.
+    void addLayout(TT_FBX::ContentHash& hash, const MultiMeshData& multiMesh) {
+        hash.add(multiMesh.attributeCount);
+        for (uint32_t i = 0; i < multiMesh.attributeCount; ++i) {
+            const VertexAttribute& attribute = multiMesh.attributeLayout[i];
+            hash.add(attribute.semantic);
+            hash.add(attribute.numElements);
+            hash.add(attribute.elementType);
+            hash.add(attribute.stream);
+            hash.add(attribute.offset);
+            hash.add(attribute.stride);
+        }
+        hash.add(multiMesh.primitiveType);
+        hash.add(multiMesh.indexElementSizeInBytes);
+        hash.add(multiMesh.streamCount);
+    }
+
+    void addMorphTargets(TT_FBX::ContentHash& hash, const MorphTarget* targets, uint32_t count) {
+        hash.add(count);
+        for (uint32_t i = 0; i < count; ++i) {
+            const MorphTarget& target = targets[i];
+            size_t deltaFloats = target.deltaCount * 3;
+            addArray(hash, target.vertices, target.deltaCount);
+            addArray(hash, target.positionDeltas, target.positionDeltas ? deltaFloats : 0);
+            addArray(hash, target.normalDeltas, target.normalDeltas ? deltaFloats : 0);
+            addArray(hash, target.quantizedPositionDeltas, target.quantizedPositionDeltas ? deltaFloats : 0);
+            addArray(hash, target.quantizedNormalDeltas, target.quantizedNormalDeltas ? deltaFloats : 0);
+            hash.add(target.positionScale);
+            hash.add(target.normalScale);
+        }
+    }
+
+    // Hash of the geometry of a submesh as extracted: layout, vertices, indices, LODs, meshlets and morph targets.
+    // Material and joints are left out, they are indices into tables that differ between files.
+    uint64_t hashSubMesh(const MultiMeshData& multiMesh, const MeshData& mesh) {
+        TT_FBX::ContentHash hash;
+        hash.add(CONTENT_HASH_VERSION);
+        addLayout(hash, multiMesh);
+        hash.add(mesh.indexCount);
+        hash.add(mesh.baseVertex);
+        if (multiMesh.sharedVertexDataBlob) {
+            hash.addBytes(multiMesh.sharedVertexDataBlob, multiMesh.sharedVertexDataSizeInBytes);
+            addArray(hash, multiMesh.sharedStreamOffsets, multiMesh.streamCount);
+            addArray(hash, (const uint32_t*)multiMesh.sharedIndexDataBlob + mesh.firstIndex, mesh.indexCount);
+        } else {
+            hash.add(mesh.vertexCount);
+            hash.addBytes(mesh.vertexDataBlob, mesh.vertexDataSizeInBytes);
+            addArray(hash, mesh.streamOffsets, multiMesh.streamCount);
+            hash.addBytes(mesh.indexDataBlob, mesh.indexDataSizeInBytes);
+        }
+
+        addArray(hash, mesh.meshlets, mesh.meshletCount);
+        addArray(hash, mesh.meshletVertices, mesh.meshletVertexCount);
+        addArray(hash, mesh.meshletTriangles, mesh.meshletTriangleCount);
+        addArray(hash, mesh.lods, mesh.lodCount);
+        addArray(hash, mesh.lodIndices, mesh.lodIndexCount);
+
+        if (multiMesh.sharedVertexDataBlob)
+            addMorphTargets(hash, multiMesh.sharedMorphTargets, multiMesh.morphTargetNameCount);
+        else
+            addMorphTargets(hash, mesh.morphTargets, mesh.morphTargetCount);
+        return hash.value();
+    }
+
+    // Hash of a whole mesh: the submesh hashes plus the names they refer to. The mesh name and joint nodes are left out,
+    // so the same asset exported into different scenes gets the same hash.
+    uint64_t hashMultiMesh(const MultiMeshData& multiMesh) {
+        TT_FBX::ContentHash hash;
+        hash.add(CONTENT_HASH_VERSION);
+        hash.add(multiMesh.materialNameCount);
+        for (uint32_t i = 0; i < multiMesh.materialNameCount; ++i)
+            addString(hash, multiMesh.materialNames[i]);
+        hash.add(multiMesh.uvSetNameCount);
+        for (uint32_t i = 0; i < multiMesh.uvSetNameCount; ++i)
+            addString(hash, multiMesh.uvSetNames[i]);
+        hash.add(multiMesh.morphTargetNameCount);
+        for (uint32_t i = 0; i < multiMesh.morphTargetNameCount; ++i)
+            addString(hash, multiMesh.morphTargetNames[i]);
+        hash.add(multiMesh.jointCount);
+        hash.add(multiMesh.meshCount);
+        for (uint32_t i = 0; i < multiMesh.meshCount; ++i) {
+            hash.add(multiMesh.meshes[i].materialId);
+            hash.add(multiMesh.meshes[i].contentHash);
+        }
+        return hash.value();
+    }
+}
+
+namespace TT_FBX {
+    MultiMeshData extractMesh(const FbxNode* owner, const FbxArray<FbxNode*>& stack, const MeshExtractSettings& settings, Arena& arena, BufferBudget& budget) {
+        const FbxMesh* mesh = (const FbxMesh*)owner->GetNodeAttribute();
 
         // Extract skin weights.
         SkinnedMeshInfo skin = extractSkinWeights(mesh, stack);
         bool isSkinned = skin.orderedSkinWeights.size() != 0;
         
         // Verify we can fully export this mesh.
+        // Smoothing is only used by normal generation.
         if (mesh->GetElementPolygonGroupCount() != 0 ||
-            mesh->GetElementSmoothingCount() != 0 ||
+            (mesh->GetElementSmoothingCount() != 0 && !((int)settings.flags & (int)MeshExtractFlags::GenerateNormals)) ||
             mesh->GetElementVertexCreaseCount() != 0 ||
             mesh->GetElementEdgeCreaseCount() != 0 ||
             mesh->GetElementHoleCount() != 0 ||
@@ -321,14 +1230,42 @@ namespace {
             // TODO: warning, unsupported vertex attribute.
         }
 
+        // Layers left out by the settings are never read, so they don't split vertices either
+        LayerCounts limits = getLayerLimits(settings);
+        LayerCounts layers = getLayerCounts(mesh, limits);
+
         // Extract uv set names
-        std::vector<std::string> uvSetNames = getUvSetNames(mesh);
+        std::vector<std::string> uvSetNames = getUvSetNames(mesh, layers.uvs);
+
+        // Normals and tangents are generated per polygon vertex before deduplication, so vertices only merge when those match.
+        // Tangents need normals, so those are generated for them even when only the tangents are stored.
+        bool generateTangents = ((int)settings.flags & (int)MeshExtractFlags::GenerateTangents) && limits.tangents > 0 &&
+            mesh->GetElementTangentCount() == 0 && mesh->GetElementUVCount() > 0;
+        bool generateNormals = ((int)settings.flags & (int)MeshExtractFlags::GenerateNormals) && mesh->GetElementNormalCount() == 0 &&
+            (limits.normals > 0 || generateTangents);
+        generateTangents = generateTangents && (generateNormals || mesh->GetElementNormalCount() > 0);
+        GeneratedAttributes generated;
+        if (generateNormals || generateTangents) {
+            TT_FBX::CornerGeometry corners = getCornerGeometry(mesh);
+            if (generateNormals) {
+                corners.normals = TT_FBX::generateNormals(corners, getNormalSmoothing(mesh, corners, settings.normalCreaseAngle));
+                if (limits.normals > 0)
+                    generated.normals = corners.normals;
+            }
+            if (generateTangents)
+                generated.tangents = TT_FBX::generateTangents(corners);
+        }
 
         // Get vertex layout
-        std::vector<VertexAttribute> layout = getMeshVertexLayout(mesh, isSkinned);
+        std::vector<VertexAttribute> layout = getMeshVertexLayout(layers, isSkinned, generated);
         
         // Get number of bytes per vertex
         int stride = strideFromlayout(layout);
+        uint32_t streamCount = assignVertexStreams(layout, settings);
+
+        // Morph targets move control points, so vertices of different control points must stay apart even when their data matches.
+        std::vector<BlendShapeTarget> morphTargets = getBlendShapeTargets(mesh);
+        bool trackSourceCorners = !morphTargets.empty();
 
         // Set up a vertex buffer to write vertex data into.
         Vertex vertexBuffer;
@@ -337,160 +1274,281 @@ namespace {
         std::hash<std::string_view> hasher;
         std::string_view view((const char* const)vertexBuffer.binaryArray.data(), vertexBuffer.binaryArray.size());
 
-        // For each material we hash the name and store a submesh with the data for that mesh.
-        std::unordered_map<size_t, ManagedMeshData> subMeshByMaterial;
-        // For each submesh (same material hash as key), we store the hash of each vertex, and the index of that vertex.
-        // That way, when the vertexBuffer hash already exists, we reuse the existing data instead of writing it twice.
-        std::unordered_map<size_t, std::unordered_map<size_t, uint32_t>> vertexMaps;
+        // Resolve the material of every polygon up front, then emit the polygons one submesh at a time.
+        PolygonsByMaterial polygons = groupPolygonsByMaterial(mesh, owner);
+        std::vector<std::string> materialNames = std::move(polygons.materialNames);
+        std::vector<ManagedMeshData> subMeshByMaterial(materialNames.size());
 
-        // Track used material names as we encounter them
-        int materialCount = mesh->GetElementMaterialCount();
-        std::vector<std::string> materialNames;
-        // Use a map to speed up finding whether we can insert a material name or not
-        // TODO: Can shouldn't we use an ordered set instead?
-        std::unordered_map<size_t, size_t> materialNamesHashToIndex;
-        std::hash<std::string> strHasher;
-
-        // If the mesh has materials assigned, we can query which material to use from that mesh attribute
-        FbxLayerElementArrayTemplate<int>* materialIndices = NULL;
-        FbxGeometryElement::EMappingMode materialMappingMode = FbxGeometryElement::eNone;
-
-        // Count the total number of vertices written so far
-        size_t globalVertexIndex = 0;
-        for (int polygonIndex = 0; polygonIndex < mesh->GetPolygonCount(); ++polygonIndex) {
-            // We only support polygons with a surface area
-            int polygonVertexCount = mesh->GetPolygonSize(polygonIndex);
-            if (polygonVertexCount < 3) {
-                globalVertexIndex += 2;
-                continue;
-            }
-            
-            // Get the material for the current face.
-            int localMaterialIndex = 0;
-            if (materialCount > 0) {
-                materialIndices = &mesh->GetElementMaterial()->GetIndexArray();
-                materialMappingMode = mesh->GetElementMaterial()->GetMappingMode();
-            }
-            if (materialIndices && materialMappingMode == FbxGeometryElement::eByPolygon)
-                localMaterialIndex = materialIndices->GetAt(polygonIndex);
-            FbxSurfaceMaterial* material = owner->GetMaterial(localMaterialIndex);
-
-            // Generate a new submesh and insert the material name if this is the first time we see this material
-            size_t nameHash = strHasher(material->GetName());
-            if (subMeshByMaterial.find(nameHash) == subMeshByMaterial.end()) {
-                materialNamesHashToIndex[nameHash] = materialNames.size();
-                materialNames.push_back(material->GetName());
-                
-                subMeshByMaterial[nameHash] = {};
-                vertexMaps[nameHash] = {};
-            }
+        // For each submesh we store the hash of each vertex, and the index of that vertex.
+        // That way, when the vertexBuffer hash already exists, we reuse the existing data instead of writing it twice.
+        // Submeshes are emitted one after the other, so they can reuse the same map.
+        std::unordered_map<size_t, uint32_t> vertexIndices;
+        // With a shared vertex buffer all submeshes write their vertices into this one and keep the map.
+        bool shareVertices = (int)settings.flags & (int)MeshExtractFlags::SharedVertexBuffer;
+        ManagedMeshData sharedMesh;
 
+        for (uint32_t materialId = 0; materialId < (uint32_t)subMeshByMaterial.size(); ++materialId) {
             // Get the submesh to write into
-            ManagedMeshData& subMesh = subMeshByMaterial.find(nameHash)->second;
-
-            // Get the vertex hash -> vertex index map for this submesh
-            std::unordered_map<size_t, uint32_t>& vertexIndices = vertexMaps.find(nameHash)->second;
-
-            // For polygons with more than 1 vertex we will track the first 
-            // and previous vertex index so we can generate triangle fans.
-            // TODO: Use earcut library instead?
-            uint32_t anchor;
-            uint32_t prev;
-
-            // Read the vertices for this polygon
-            for (size_t vertexIndex = 0; vertexIndex < polygonVertexCount; ++vertexIndex) {
-                // This will fully overwrite the vertexBuffer with data for the current globalVertexIndex
-                getVertex(mesh, polygonIndex, vertexIndex, globalVertexIndex, vertexBuffer, skin.orderedSkinWeights);
-
-                // Hash the vertex and insert it if it is unique
-                size_t hash = hasher(view);
-                uint32_t index;
-                auto it = vertexIndices.find(hash);
-                if (it == vertexIndices.end()) {
-                    index = (uint32_t)(subMesh.vertexData.size() / stride);
-                    vertexIndices[hash] = index;
-                    subMesh.vertexData.insert(subMesh.vertexData.end(), vertexBuffer.binaryArray.begin(), vertexBuffer.binaryArray.end());
-                }  else {
-                    // Else just reuse the existing vertex
-                    index = it->second;
+            ManagedMeshData& subMesh = subMeshByMaterial[materialId];
+            subMesh.materialId = materialId;
+            ManagedMeshData& vertexOwner = shareVertices ? sharedMesh : subMesh;
+            std::vector<unsigned char>& vertexData = vertexOwner.vertexData;
+            if (!shareVertices)
+                vertexIndices.clear();
+
+            for (uint32_t cursor = polygons.offsets[materialId]; cursor < polygons.offsets[materialId + 1]; ++cursor) {
+                int polygonIndex = polygons.polygons[cursor];
+                int polygonVertexCount = mesh->GetPolygonSize(polygonIndex);
+                // Index of the first vertex of this polygon in the flat polygon vertex array, for data mapped by polygon vertex.
+                size_t globalVertexIndex = (size_t)mesh->GetPolygonVertexIndex(polygonIndex);
+
+                // For polygons with more than 1 vertex we will track the first 
+                // and previous vertex index so we can generate triangle fans.
+                // TODO: Use earcut library instead?
+                uint32_t anchor;
+                uint32_t prev;
+
+                // Read the vertices for this polygon
+                for (size_t vertexIndex = 0; vertexIndex < polygonVertexCount; ++vertexIndex) {
+                    // This will fully overwrite the vertexBuffer with data for the current globalVertexIndex
+                    getVertex(mesh, polygonIndex, vertexIndex, globalVertexIndex, vertexBuffer, skin.orderedSkinWeights, layers, generated);
+
+                    // Hash the vertex and insert it if it is unique
+                    size_t hash = hasher(view);
+                    if (trackSourceCorners)
+                        hash ^= std::hash<uint32_t>()((uint32_t)mesh->GetPolygonVertex(polygonIndex, (int)vertexIndex)) * (size_t)0x9E3779B97F4A7C15ull;
+                    uint32_t index;
+                    auto it = vertexIndices.find(hash);
+                    if (it == vertexIndices.end()) {
+                        index = (uint32_t)(vertexData.size() / stride);
+                        vertexIndices[hash] = index;
+                        vertexData.insert(vertexData.end(), vertexBuffer.binaryArray.begin(), vertexBuffer.binaryArray.end());
+                        if (trackSourceCorners)
+                            vertexOwner.sourceCorners.push_back((uint32_t)globalVertexIndex);
+                    }  else {
+                        // Else just reuse the existing vertex
+                        index = it->second;
+                    }
+
+                    // Add the index
+                    subMesh.indexData.push_back(index);
+
+                    // Triangle-fan polygons with more than 3 vertices
+                    if (vertexIndex > 2) {
+                        subMesh.indexData.push_back(prev);
+                        subMesh.indexData.push_back(anchor);
+                    }
+
+                    ++globalVertexIndex;
+                    prev = index;
+                    if (vertexIndex == 0)
+                        anchor = index;
                 }
+            }
+        }
 
-                // Add the index
-                subMesh.indexData.push_back(index);
-
-                // Triangle-fan polygons with more than 3 vertices
-                if (vertexIndex > 2) {
-                    subMesh.indexData.push_back(prev);
-                    subMesh.indexData.push_back(anchor);
-                }
+        // The deduplication map is not needed anymore, free it before the optimization passes allocate
+        vertexIndices = {};
+        polygons = {};
+
+        // Submeshes are independent, so we process them in parallel, shared vertex buffers synchronize between stages.
+        std::vector<ManagedMeshData*> subMeshes;
+        for (ManagedMeshData& subMesh : subMeshByMaterial)
+            subMeshes.push_back(&subMesh);
+
+        // Welding only changes which vertices the triangles use, so it runs before every stage that looks at the triangles.
+        if ((int)settings.flags & (int)MeshExtractFlags::WeldVertices) {
+            if (shareVertices)
+                weldVertices(sharedMesh, subMeshes, mesh, layout, stride, settings);
+            else
+                TT_FBX::parallelFor(subMeshes.size(), [&](size_t i) { weldVertices(*subMeshes[i], { subMeshes[i] }, mesh, layout, stride, settings); });
+        }
 
-                ++globalVertexIndex;
-                prev = index;
-                if (vertexIndex == 0)
-                    anchor = index;
-            }
+        if (shareVertices)
+            optimizeSharedMesh(sharedMesh, subMeshes, layout, stride, streamCount, settings);
+        else
+            TT_FBX::parallelFor(subMeshes.size(), [&](size_t i) { optimizeSubMesh(*subMeshes[i], layout, stride, streamCount, settings); });
+
+        // Morph targets are keyed to the final vertex order.
+        std::vector<ManagedMeshData*> vertexOwners = shareVertices ? std::vector<ManagedMeshData*>{ &sharedMesh } : subMeshes;
+        buildMorphTargets(mesh, morphTargets, vertexOwners, layout, (int)settings.flags & (int)MeshExtractFlags::QuantizeMorphTargets);
+
+        // Bounds come from the final vertex data, so vertices dropped by the processing stages don't count.
+        Bounds meshBounds = computeMeshBounds(subMeshByMaterial, shareVertices ? &sharedMesh : nullptr, layout, stride);
+        std::vector<Bounds> jointBounds;
+        if (isSkinned)
+            jointBounds = computeJointBounds(vertexOwners, layout, stride, skin.meshToJoint);
+
+        MultiMeshData result;
+        result.version = arena.makeString("2");
+        result.name = arena.makeString(mesh->GetName());
+        result.materialNameCount = (uint32_t)materialNames.size();
+        result.materialNames = arena.makeStringList(materialNames);
+        result.uvSetNameCount = (uint32_t)uvSetNames.size();
+        result.uvSetNames = arena.makeStringList(uvSetNames);
+        result.attributeCount = (uint32_t)layout.size();
+        result.attributeLayout = arena.flattenList(layout);
+        result.primitiveType = 0x0004; // GL_TRIANGLES
+        result.indexElementSizeInBytes = sizeof(uint32_t);
+        result.meshCount = (uint32_t)subMeshByMaterial.size();
+        result.meshes = flattenValues(subMeshByMaterial, stride, shareVertices ? &sharedMesh : nullptr, arena, budget);
+        result.jointCount = (uint32_t)skin.jointIdToNodeMap.size();
+        result.jointIndexData = arena.flattenList(skin.jointIdToNodeMap);
+        result.streamCount = streamCount;
+        result.bounds = meshBounds;
+        result.jointBounds = arena.flattenList(jointBounds);
+
+        std::vector<std::string> morphTargetNames;
+        for (const BlendShapeTarget& target : morphTargets)
+            morphTargetNames.push_back(target.name);
+        result.morphTargetNameCount = (uint32_t)morphTargetNames.size();
+        result.morphTargetNames = arena.makeStringList(morphTargetNames);
+
+        if (shareVertices) {
+            result.sharedVertexCount = (uint32_t)(sharedMesh.vertexData.size() / stride);
+            result.sharedVertexDataSizeInBytes = sharedMesh.vertexData.size();
+            result.sharedVertexDataBlob = budget.adopt(std::move(sharedMesh.vertexData));
+            result.sharedStreamOffsets = arena.flattenList(sharedMesh.streamOffsets);
+            result.sharedIndexDataSizeInBytes = sharedMesh.indexData.size() * sizeof(uint32_t);
+            result.sharedIndexDataBlob = (unsigned char*)budget.adopt(std::move(sharedMesh.indexData));
+            result.sharedMorphTargets = flattenMorphTargets(sharedMesh.morphTargets, arena);
         }
 
-        return {
-            TT_FBX::makeString("1"),
-            TT_FBX::makeString(mesh->GetName()),
-            (uint32_t)materialNames.size(),
-            makeStringList(materialNames),
-            (uint32_t)uvSetNames.size(),
-            makeStringList(uvSetNames),
-            (uint32_t)layout.size(),
-            TT_FBX::flattenList(layout),
-            0x0004, // GL_TRIANGLES
-            sizeof(uint32_t),
-            (uint32_t)subMeshByMaterial.size(),
-            flattenValues(subMeshByMaterial),
-            (uint32_t)skin.jointIdToNodeMap.size(),
-            TT_FBX::flattenList(skin.jointIdToNodeMap)
-        };
+        // Hashed last, from exactly what the caller gets
+        for (uint32_t i = 0; i < result.meshCount; ++i)
+            result.meshes[i].contentHash = hashSubMesh(result, result.meshes[i]);
+        result.contentHash = hashMultiMesh(result);
+        return result;
     }
 }
 
 extern "C" {
-    __declspec(dllexport) MultiMeshData* extractMeshes(const FbxImportContext* context, uint32_t* outCount) {
+    __declspec(dllexport) MultiMeshData* extractMeshes(const FbxImportContext* context, const MeshExtractSettings* settings, uint32_t* outCount) {
         if (!TT_FBX::checkContext(context)) {
             *outCount = 0;
             return nullptr;
         }
 
-        std::vector<MultiMeshData> result;
+        // Null settings means defaults
+        MeshExtractSettings defaultSettings;
+        if (!settings)
+            settings = &defaultSettings;
+
+        // Instanced meshes are only extracted once, see SceneInfo::meshNodes.
+        // The result array is the first allocation so freeMeshes can find the arena from it
+        const FbxArray<FbxNode*>& meshNodes = context->info->meshNodes;
+        TT_FBX::Arena arena;
+        MultiMeshData* result = arena.allocate<MultiMeshData>(meshNodes.GetCount());
+        TT_FBX::BufferBudget budget(arena, settings->memoryBudget, settings->spillDirectory);
+        for (int i = 0; i < meshNodes.GetCount(); ++i)
+            result[i] = extractMesh(meshNodes[i], context->info->transforms, *settings, arena, budget);
+
+        arena.detach();
+        *outCount = (uint32_t)meshNodes.GetCount();
+        return result;
+    }
 
-        for (int i = 0; i < context->info->transforms.GetCount(); ++i) {
-            FbxNode* node = context->info->transforms[i];
-            if (node->GetNodeAttribute() && node->GetNodeAttribute()->GetAttributeType() == FbxNodeAttribute::eMesh) {
-                result.push_back(extractMesh((FbxMesh*)node->GetNodeAttribute(), context->info->transforms));
+    __declspec(dllexport) bool extractMeshesStreamed(const FbxImportContext* context, const MeshExtractSettings* settings, SubMeshCallback callback, void* userData) {
+        if (!TT_FBX::checkContext(context) || !callback)
+            return false;
+
+        MeshExtractSettings defaultSettings;
+        if (!settings)
+            settings = &defaultSettings;
+
+        // Every mesh gets its own arena, which frees its buffers when it goes out of scope.
+        // Only one mesh is in memory at a time, so a budget per mesh is what bounds the memory of the whole scene.
+        const FbxArray<FbxNode*>& meshNodes = context->info->meshNodes;
+        for (int i = 0; i < meshNodes.GetCount(); ++i) {
+            TT_FBX::Arena arena;
+            TT_FBX::BufferBudget budget(arena, settings->memoryBudget, settings->spillDirectory);
+            MultiMeshData mesh = extractMesh(meshNodes[i], context->info->transforms, *settings, arena, budget);
+            for (uint32_t j = 0; j < mesh.meshCount; ++j) {
+                if (!callback(&mesh, (uint32_t)i, j, userData))
+                    return false;
             }
         }
-
-        *outCount = (uint32_t)result.size();
-        return TT_FBX::flattenList(result);
+        return true;
     }
 
-    __declspec(dllexport) void freeMeshes(const MultiMeshData* meshes, uint32_t meshCount) {
-        for (unsigned int i = 0; i < meshCount; ++i) {
-            delete[] meshes[i].version.buffer;
-            delete[] meshes[i].name.buffer;
+    __declspec(dllexport) const MultiMeshData* extractMeshAt(const FbxImportContext* context, uint32_t nodeIndex, const MeshExtractSettings* settings) {
+        if (!TT_FBX::checkContext(context))
+            return nullptr;
 
-            for (unsigned int j = 0; j < meshes[i].materialNameCount; ++j)
-                delete[] meshes[i].materialNames[j].buffer;
-            delete[] meshes[i].materialNames;
+        TT_FBX::SceneInfo& info = *context->info;
+        if (nodeIndex >= (uint32_t)info.transformMeshIds.GetCount() || info.transformMeshIds[nodeIndex] == -1)
+            return nullptr;
 
-            for (unsigned int j = 0; j < meshes[i].uvSetNameCount; ++j)
-                delete[] meshes[i].uvSetNames[j].buffer;
-            delete[] meshes[i].uvSetNames;
+        MeshExtractSettings defaultSettings;
+        if (!settings)
+            settings = &defaultSettings;
+
+        // The settings struct has no padding, so its bytes identify it, except for the spill directory which is compared by its path
+        const FbxNode* meshNode = info.meshNodes[info.transformMeshIds[nodeIndex]];
+        MeshExtractSettings keySettings = *settings;
+        keySettings.spillDirectory = nullptr;
+        std::string settingsKey((const char*)&keySettings, sizeof(MeshExtractSettings));
+        if (settings->spillDirectory)
+            settingsKey.append(1, '\1').append(settings->spillDirectory);
+        auto key = std::make_pair(meshNode, settingsKey);
+        auto it = info.extractedMeshes.find(key);
+        if (it != info.extractedMeshes.end())
+            return it->second;
+
+        // The results pile up in the context, so the budget covers all of them rather than each call
+        MultiMeshData* result = info.meshArena.allocate<MultiMeshData>(1);
+        info.meshBudget.setLimit(settings->memoryBudget, settings->spillDirectory);
+        *result = extractMesh(meshNode, info.transforms, *settings, info.meshArena, info.meshBudget);
+        info.extractedMeshes.emplace(key, result);
+        return result;
+    }
 
-            delete[] meshes[i].attributeLayout;
+    __declspec(dllexport) void freeExtractedMeshes(const FbxImportContext* context) {
+        if (!TT_FBX::checkContext(context))
+            return;
 
-            for (unsigned int j = 0; j < meshes[i].meshCount; ++j) {
-                delete[] meshes[i].meshes[j].vertexDataBlob;
-                delete[] meshes[i].meshes[j].indexDataBlob;
+        TT_FBX::SceneInfo& info = *context->info;
+        info.extractedMeshes.clear();
+        info.meshArena.clear();
+        info.meshBudget.clear();
+    }
+
+    __declspec(dllexport) void instanceIdenticalMeshes(const FbxImportContext* context) {
+        if (!TT_FBX::checkContext(context))
+            return;
+
+        // Meshes with deformers are left alone, their clusters and shapes are tied to the mesh object
+        TT_FBX::SceneInfo& info = *context->info;
+        std::map<std::tuple<uint64_t, int, int, std::vector<FbxSurfaceMaterial*>>, int> meshIds;
+        std::vector<int> remap(info.meshNodes.GetCount());
+        FbxArray<FbxNode*> meshNodes;
+        for (int i = 0; i < info.meshNodes.GetCount(); ++i) {
+            FbxNode* node = info.meshNodes[i];
+            const FbxMesh* mesh = (const FbxMesh*)node->GetNodeAttribute();
+            if (mesh->GetDeformerCount() > 0) {
+                remap[i] = meshNodes.Add(node);
+                continue;
             }
-            delete[] meshes[i].meshes;
+            // The counts guard against hash collisions between meshes of different size
+            std::vector<FbxSurfaceMaterial*> materials;
+            for (int j = 0; j < node->GetMaterialCount(); ++j)
+                materials.push_back(node->GetMaterial(j));
+            auto key = std::make_tuple(hashMeshGeometry(mesh), mesh->GetControlPointsCount(), mesh->GetPolygonVertexCount(), materials);
+            auto inserted = meshIds.emplace(key, meshNodes.GetCount());
+            if (inserted.second)
+                meshNodes.Add(node);
+            remap[i] = inserted.first->second;
+        }
+
+        for (int i = 0; i < info.transformMeshIds.GetCount(); ++i) {
+            if (info.transformMeshIds[i] != -1)
+                info.transformMeshIds[i] = remap[info.transformMeshIds[i]];
         }
-        delete[] meshes;
+        info.meshNodes = meshNodes;
+    }
+
+    __declspec(dllexport) void freeMeshes(const MultiMeshData* meshes, uint32_t /*meshCount*/) {
+        // Everything was allocated in one arena
+        TT_FBX::Arena::release(meshes);
     }
 }
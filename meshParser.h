@@ -42,7 +42,10 @@ extern "C" {
         Float = 0x1406,
     };
 
-    // All vertex data comes interleaved as 1 buffer.
+    // Semantic is 8 bit, tables indexed by it have this many entries.
+    constexpr uint32_t SEMANTIC_COUNT = 256;
+
+    // By default all vertex data comes interleaved as 1 buffer, see VertexStreamMode for alternatives.
     // This layout describes which bytes represent what information
     // and is intended to be used in conjunction with glVertexAttribPointer.
     // The semantic integer will probably exceed GL_MAX_VERTEX_ATTRIBS,
@@ -54,23 +57,161 @@ extern "C" {
         NumElements numElements = NumElements::Vec3;
         // GLenum that directly feeds glVertexAttribPointer
         ElementType elementType = ElementType::Float;
+        // Which stream holds this attribute, see MeshData::streamOffsets.
+        uint8_t stream = 0;
+        // Byte offset of this attribute within a vertex of its stream.
+        uint32_t offset = 0;
+        // Bytes per vertex in the stream.
+        uint32_t stride = 0;
+    };
+
+    // Statistics gathered by the optional processing stages in extractMeshes, left 0 when a stage did not run.
+    struct MeshStatistics {
+        // Vertices that no triangle referenced, removed by vertex fetch optimization.
+        uint32_t unusedVerticesRemoved = 0;
+        // Bytes fetched from memory divided by the size of the referenced vertex data, 1.0 is optimal.
+        float overfetchBefore = 0.0f;
+        float overfetchAfter = 0.0f;
+        // Vertices merged into a nearby vertex by MeshExtractFlags::WeldVertices.
+        uint32_t verticesWelded = 0;
+    };
+
+    // Axis aligned bounding box and bounding sphere, for culling.
+    struct Bounds {
+        float min[3] = {};
+        float max[3] = {};
+        float center[3] = {};
+        // -1 when there was nothing to bound.
+        float radius = -1.0f;
+    };
+
+    // A small cluster of triangles for mesh shaders and cluster culling.
+    struct Meshlet {
+        // First element in MeshData::meshletVertices.
+        uint32_t vertexOffset = 0;
+        // First element in MeshData::meshletTriangles.
+        uint32_t triangleOffset = 0;
+        uint32_t vertexCount = 0;
+        uint32_t triangleCount = 0;
+
+        // Bounding sphere.
+        float center[3] = {};
+        float radius = 0.0f;
+
+        // Normal cone, the meshlet faces away from the camera when
+        // dot(normalize(coneApex - cameraPosition), coneAxis) >= coneCutoff.
+        float coneApex[3] = {};
+        float coneAxis[3] = {};
+        float coneCutoff = 1.0f;
+    };
+
+    // A node of a bounding volume hierarchy over the triangles of a submesh, 32 bytes so two siblings share a cache line.
+    struct BvhNode {
+        float min[3] = {};
+        // Interior nodes: index of the left child, the right child follows it. Leaves: first element in MeshData::bvhTriangles.
+        uint32_t leftOrFirst = 0;
+        float max[3] = {};
+        // Triangles in a leaf, 0 for interior nodes.
+        uint32_t triangleCount = 0;
+    };
+
+    // The most simplified LODs extractMeshes can generate per submesh.
+    constexpr uint32_t MAX_LOD_COUNT = 8;
+
+    // A simplified version of a submesh, as a range in MeshData::lodIndices.
+    struct MeshLod {
+        uint32_t firstIndex = 0;
+        uint32_t indexCount = 0;
+        // Largest deviation from the original surface, relative to the largest dimension of the submesh bounds.
+        float error = 0.0f;
+    };
+
+    // One blend shape channel as sparse deltas on a vertex buffer, vertices that are not listed don't move.
+    // The deltas are floats, or 16 bit integers with MeshExtractFlags::QuantizeMorphTargets,
+    // in which case delta = quantized * positionScale (or normalScale).
+    struct MorphTarget {
+        uint32_t deltaCount = 0;
+        // Vertex indices in ascending order. These never need baseVertex, with a shared vertex buffer they index it directly.
+        uint32_t* vertices = nullptr;
+        // 3 per delta, nullptr when quantized.
+        float* positionDeltas = nullptr;
+        // 3 per delta, nullptr when quantized or when the mesh has no normals.
+        float* normalDeltas = nullptr;
+        // 3 per delta, nullptr when not quantized.
+        int16_t* quantizedPositionDeltas = nullptr;
+        // 3 per delta, nullptr when not quantized or when the mesh has no normals.
+        int16_t* quantizedNormalDeltas = nullptr;
+        float positionScale = 0.0f;
+        float normalScale = 0.0f;
     };
 
     // A mesh is split up by material, the submeshes share the same vertex attributes
     // but have their own vertex and index buffers, as well as a handle to identify the material.
+    // With MeshExtractFlags::SharedVertexBuffer the submeshes are ranges of buffers in MultiMeshData instead.
     struct MeshData {
         // An index into MultiMeshData::materialNames
         uint32_t materialId = 0;
 
-        uint32_t vertexDataSizeInBytes = 0;
-        uint32_t indexDataSizeInBytes = 0; // can be 0
+        // The indices to draw, glDrawElementsBaseVertex style. Without a shared vertex buffer this is always the whole index buffer
+        // and baseVertex is 0. With one, firstIndex and indexCount select part of MultiMeshData::sharedIndexDataBlob
+        // and baseVertex must be added to every index, this includes the LOD indices.
+        uint32_t firstIndex = 0;
+        uint32_t indexCount = 0;
+        uint32_t baseVertex = 0;
+
+        // These are all 0 with a shared vertex buffer. Sizes and offsets are 64 bit, scanned meshes easily exceed 4 GiB of vertex data.
+        uint64_t vertexDataSizeInBytes = 0;
+        uint64_t indexDataSizeInBytes = 0; // can be 0
 
         uint8_t* vertexDataBlob = nullptr;
         uint8_t* indexDataBlob = nullptr;
+
+        uint32_t vertexCount = 0;
+        // Byte offset of every vertex stream in vertexDataBlob, MultiMeshData::streamCount elements.
+        // Streams are stored back to back, each holds vertexCount elements of its stride.
+        uint64_t* streamOffsets = nullptr;
+
+        MeshStatistics statistics;
+
+        // Only filled when MeshExtractFlags::BuildMeshlets is set.
+        uint32_t meshletCount = 0;
+        Meshlet* meshlets = nullptr;
+        // Indices into the vertex buffer, a meshlet's local vertex i is meshletVertices[vertexOffset + i].
+        // These never need baseVertex, with a shared vertex buffer they index it directly.
+        uint32_t meshletVertexCount = 0;
+        uint32_t* meshletVertices = nullptr;
+        // One triangle per element, 3 meshlet-local vertex indices packed as 8 bits each (v0 | v1 << 8 | v2 << 16).
+        uint32_t meshletTriangleCount = 0;
+        uint32_t* meshletTriangles = nullptr;
+
+        // Only filled when MeshExtractSettings::lodCount is not 0.
+        // LODs index the same vertex buffer as the full detail mesh, ordered from most to least detailed.
+        uint32_t lodCount = 0;
+        MeshLod* lods = nullptr;
+        uint32_t lodIndexCount = 0;
+        uint32_t* lodIndices = nullptr;
+
+        // Bounds of the vertices this submesh references.
+        Bounds bounds;
+
+        // One per MultiMeshData::morphTargetNames, 0 with a shared vertex buffer, see MultiMeshData::sharedMorphTargets.
+        uint32_t morphTargetCount = 0;
+        MorphTarget* morphTargets = nullptr;
+
+        // Stable hash of everything above except the material, equal for identical geometry extracted from different files.
+        uint64_t contentHash = 0;
+
+        // Only filled when MeshExtractFlags::BuildBvh is set, not part of contentHash. Node 0 is the root.
+        uint32_t bvhNodeCount = 0;
+        BvhNode* bvhNodes = nullptr;
+        // Triangle t of the submesh is indices 3t to 3t + 2, counted from firstIndex with a shared vertex buffer.
+        uint32_t bvhTriangleCount = 0;
+        uint32_t* bvhTriangles = nullptr;
     };
 
     // Each FbxMesh in the scene gets converted to a MutliMeshData instance.
     struct MultiMeshData {
+        // Layout version of these structs, "2" since byte sizes and stream offsets are 64 bit.
         String version;
 
         String name;
@@ -93,8 +234,157 @@ extern "C" {
 
         uint32_t jointCount = 0;
         uint32_t* jointIndexData = nullptr;
+
+        // Number of vertex streams in every submesh, 1 unless vertex data is de-interleaved.
+        uint32_t streamCount = 0;
+
+        // Only filled when MeshExtractFlags::SharedVertexBuffer is set. One vertex buffer deduplicated
+        // across all materials and one index buffer that holds the ranges of all submeshes.
+        uint32_t sharedVertexCount = 0;
+        uint64_t sharedVertexDataSizeInBytes = 0;
+        uint8_t* sharedVertexDataBlob = nullptr;
+        // Byte offset of every vertex stream in sharedVertexDataBlob, streamCount elements.
+        uint64_t* sharedStreamOffsets = nullptr;
+        uint64_t sharedIndexDataSizeInBytes = 0;
+        uint8_t* sharedIndexDataBlob = nullptr;
+
+        // Bounds of all submeshes together.
+        Bounds bounds;
+        // Only filled for skinned meshes, jointCount elements. Bounds of the vertices each joint influences,
+        // in the space of the joint at bind time, so they can be transformed with the animated joint matrix.
+        Bounds* jointBounds = nullptr;
+
+        // Names of the blend shape channels of the mesh, every submesh has a morph target per name.
+        // Only the full weight target of a channel is extracted, in-between targets are skipped.
+        uint32_t morphTargetNameCount = 0;
+        String* morphTargetNames = nullptr;
+        // With a shared vertex buffer the morph targets apply to that instead, morphTargetNameCount elements.
+        MorphTarget* sharedMorphTargets = nullptr;
+
+        // Stable hash of the submesh hashes, their materials and all names except the mesh name.
+        // Joints only count by number, their node indices depend on the scene.
+        uint64_t contentHash = 0;
+    };
+
+    // Bitfield, set bits to enable optional processing stages in extractMeshes.
+    enum class MeshExtractFlags : uint32_t {
+        // Reorder triangles for post-transform vertex cache efficiency.
+        OptimizeVertexCache = 1 << 0,
+        // Reorder triangle clusters so likely occluders are drawn first, implies OptimizeVertexCache.
+        OptimizeOverdraw = 1 << 1,
+        // Renumber vertices in the order the final index buffer uses them and drop unreferenced vertices.
+        OptimizeVertexFetch = 1 << 2,
+        // Split each submesh into meshlets, see MeshData::meshlets.
+        BuildMeshlets = 1 << 3,
+        // Deduplicate vertices across materials into one vertex buffer, see MeshData::firstIndex.
+        SharedVertexBuffer = 1 << 4,
+        // Generate MikkTSpace tangents for meshes that have normals and uvs but no tangents, from the first uv set.
+        // They are added as a Vec4 Tangent attribute, w is the bitangent sign: bitangent = w * cross(normal, tangent).
+        GenerateTangents = 1 << 5,
+        // Generate normals for meshes without them, from the smoothing groups or soft edges if there are any,
+        // otherwise by MeshExtractSettings::normalCreaseAngle. Tangent generation uses these as well.
+        GenerateNormals = 1 << 6,
+        // Store morph target deltas as 16 bit integers, see MorphTarget.
+        QuantizeMorphTargets = 1 << 7,
+        // Merge vertices whose attributes are within the MeshExtractSettings weld tolerances, on top of exact deduplication.
+        // Vertices of different control points are never merged when the mesh has morph targets.
+        WeldVertices = 1 << 8,
+        // Build a bounding volume hierarchy over the triangles of each submesh for ray casts and picking, see MeshData::bvhNodes.
+        BuildBvh = 1 << 9,
+    };
+
+    // Bitfield of the attribute kinds extractMeshes reads, see MeshExtractSettings::semanticMask. Positions and skinning are always read.
+    enum class SemanticMask : uint32_t {
+        Normal = 1 << 0,
+        Tangent = 1 << 1,
+        Binormal = 1 << 2,
+        UV = 1 << 3,
+        Color = 1 << 4,
+        All = Normal | Tangent | Binormal | UV | Color,
+    };
+
+    // How extractMeshes lays out the vertex data of a submesh.
+    // Deduplication and all processing stages still work on whole vertices, streams are split up last.
+    enum class VertexStreamMode : uint32_t {
+        // All attributes in a single interleaved stream.
+        Interleaved = 0,
+        // Every attribute in its own tightly packed stream.
+        PerAttribute,
+        // Attributes are interleaved per stream, the stream of every semantic comes from MeshExtractSettings::semanticStreams.
+        Grouped,
     };
 
-    __declspec(dllexport) MultiMeshData* extractMeshes(const struct FbxImportContext* context, uint32_t* outCount);
+    // Options for extractMeshes, pass nullptr to use these defaults.
+    struct MeshExtractSettings {
+        MeshExtractFlags flags = (MeshExtractFlags)0;
+        // How much the vertex cache miss ratio may degrade in favor of overdraw, 1.05 allows it to get 5% worse.
+        float overdrawThreshold = 1.05f;
+        // Meshlet limits, meshlet-local indices are 8 bit so there can be no more than 256 vertices.
+        uint32_t maxMeshletVertices = 64;
+        uint32_t maxMeshletTriangles = 124;
+        // Number of simplified LODs to generate per submesh, at most MAX_LOD_COUNT.
+        uint32_t lodCount = 0;
+        // Per LOD, the fraction of the full detail triangle count to simplify to.
+        float lodTargetRatios[MAX_LOD_COUNT] = { 0.5f, 0.25f, 0.125f, 0.0625f, 0.03125f, 0.015625f, 0.0078125f, 0.00390625f };
+        // Per LOD, stop simplifying before the error exceeds this, relative to the largest dimension of the submesh bounds.
+        // A LOD can stop short of its target ratio because of this, the default never does.
+        float lodTargetErrors[MAX_LOD_COUNT] = { 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f };
+        // Polygons whose normals differ by more than this many degrees get a hard edge, for GenerateNormals without smoothing information.
+        float normalCreaseAngle = 60.0f;
+        VertexStreamMode streamMode = VertexStreamMode::Interleaved;
+        // Stream index per Semantic value, only used by VertexStreamMode::Grouped.
+        // Streams no attribute maps to are left empty, they keep their index so it can be relied on across meshes.
+        uint8_t semanticStreams[SEMANTIC_COUNT] = {};
+        // WeldVertices tolerances: the distance between positions, the angle in degrees between normals, tangents and binormals,
+        // and the difference per component of uvs, colors and skin weights. Skin indices must always match.
+        float weldPositionEpsilon = 1e-5f;
+        float weldNormalAngle = 0.5f;
+        float weldUvEpsilon = 1e-5f;
+        // Bytes of vertex and index buffers to keep in memory per call, 0 is unlimited. For extractMeshAt it covers every mesh the context holds,
+        // for extractMeshesStreamed the one mesh in memory at a time. Buffers past the budget are written to a temporary file
+        // and returned as copy-on-write mapped views, which live until the result is freed.
+        uint64_t memoryBudget = 0;
+        // Where the temporary file goes, nullptr for the system temp directory.
+        const char* spillDirectory = nullptr;
+        // Attribute kinds to extract, other layers are never read, hashed or stored. GenerateNormals and GenerateTangents
+        // only add kinds that are in the mask, though normals are still generated internally when only tangents are wanted.
+        SemanticMask semanticMask = SemanticMask::All;
+        // Most layers to read per kind, the first layers of the fbx mesh are used. The Semantic enum has room for 8 of each, colors excepted.
+        uint32_t maxNormalLayers = 8;
+        uint32_t maxTangentLayers = 8;
+        uint32_t maxBinormalLayers = 8;
+        uint32_t maxUvLayers = 8;
+        uint32_t maxColorLayers = 255;
+        // BuildBvh limits: leaves hold at most this many triangles, and splits are evaluated at this many planes per axis, at most 64.
+        uint32_t maxBvhLeafTriangles = 4;
+        uint32_t bvhBinCount = 16;
+    };
+
+    __declspec(dllexport) MultiMeshData* extractMeshes(const struct FbxImportContext* context, const MeshExtractSettings* settings, uint32_t* outCount);
+    // Called by extractMeshesStreamed for every submesh, mesh->meshes[subMeshIndex] is the submesh. The mesh holds the layout, material names and joints.
+    // Everything the pointers reach is freed once the last submesh of a mesh returns, copy what must be kept. Return false to stop extracting.
+    typedef bool (*SubMeshCallback)(const MultiMeshData* mesh, uint32_t meshIndex, uint32_t subMeshIndex, void* userData);
+    // Same as extractMeshes, but only one mesh is in memory at a time. Meshes are visited in extractMeshes order.
+    // Returns false if the context is invalid or the callback stopped early.
+    __declspec(dllexport) bool extractMeshesStreamed(const struct FbxImportContext* context, const MeshExtractSettings* settings, SubMeshCallback callback, void* userData);
     __declspec(dllexport) void freeMeshes(const MultiMeshData* meshes, uint32_t meshCount);
+    // Extract only the mesh of one node, nodeIndex is in extractNodes order. Returns nullptr if the node has no mesh.
+    // The result is owned by the context and freed by freeFbx or freeExtractedMeshes. It is cached, so asking again for the same mesh with
+    // the same settings returns the same pointer without extracting, this includes other nodes that instance the mesh.
+    // The cache keeps every mesh and settings combination asked for, call freeExtractedMeshes to bound it.
+    __declspec(dllexport) const MultiMeshData* extractMeshAt(const struct FbxImportContext* context, uint32_t nodeIndex, const MeshExtractSettings* settings);
+    // Free every mesh extractMeshAt returned for the context, their pointers become invalid.
+    __declspec(dllexport) void freeExtractedMeshes(const struct FbxImportContext* context);
+    // Nodes that share an FbxMesh and their materials always share the extracted mesh. This also shares meshes that are separate objects
+    // but have identical geometry, attributes and materials, found by hashing their contents.
+    // Call it before extractNodes and extractMeshes, they both see the result.
+    __declspec(dllexport) void instanceIdenticalMeshes(const struct FbxImportContext* context);
+}
+
+namespace TT_FBX {
+    class BufferBudget;
+
+    // Read the mesh of a node and return a multi-mesh with submeshes split up by the materials of that node.
+    // stack is SceneInfo::transforms, joints are indices into it.
+    MultiMeshData extractMesh(const FbxNode* owner, const FbxArray<FbxNode*>& stack, const MeshExtractSettings& settings, Arena& arena, BufferBudget& budget);
 }
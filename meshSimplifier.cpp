@@ -0,0 +1,479 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "meshOptimizer.h"
+#include "meshSimplifier.h"
+
+namespace {
+    // Border edges add a plane perpendicular to the surface with this weight so the outline of open meshes is preserved.
+    constexpr double BORDER_WEIGHT = 10.0;
+    // Skin weight differences are multiplied by the mesh size and this factor to make them comparable to distances.
+    constexpr double SKIN_WEIGHT = 0.5;
+    // A collapse may not rotate any remaining triangle further than ~75 degrees.
+    constexpr double MIN_NORMAL_DOT = 0.25;
+
+    // How a vertex is allowed to move.
+    enum class VertexKind : uint8_t {
+        // Interior of a smooth surface, can collapse onto any neighbor.
+        Manifold,
+        // On an open edge, can only collapse along that edge.
+        Border,
+        // Split in exactly 2 vertices with different attributes (UV seam, hard edge),
+        // both halves collapse along the seam together.
+        Seam,
+        // Anything more complex, never moves.
+        Locked,
+    };
+
+    struct Vec3 {
+        double x = 0.0;
+        double y = 0.0;
+        double z = 0.0;
+    };
+
+    inline Vec3 sub(const Vec3& a, const Vec3& b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+    inline double dot(const Vec3& a, const Vec3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+    inline Vec3 cross(const Vec3& a, const Vec3& b) { return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; }
+
+    // Accumulated squared distance to a set of weighted planes, evaluated as p'Ap + 2b'p + c.
+    struct Quadric {
+        double a00 = 0.0, a11 = 0.0, a22 = 0.0, a01 = 0.0, a02 = 0.0, a12 = 0.0;
+        double b0 = 0.0, b1 = 0.0, b2 = 0.0;
+        double c = 0.0;
+        double weight = 0.0;
+
+        // Plane dot(n, p) + d = 0 with unit normal n.
+        void addPlane(const Vec3& n, double d, double w) {
+            a00 += w * n.x * n.x;
+            a11 += w * n.y * n.y;
+            a22 += w * n.z * n.z;
+            a01 += w * n.x * n.y;
+            a02 += w * n.x * n.z;
+            a12 += w * n.y * n.z;
+            b0 += w * n.x * d;
+            b1 += w * n.y * d;
+            b2 += w * n.z * d;
+            c += w * d * d;
+            weight += w;
+        }
+
+        void add(const Quadric& other) {
+            a00 += other.a00;
+            a11 += other.a11;
+            a22 += other.a22;
+            a01 += other.a01;
+            a02 += other.a02;
+            a12 += other.a12;
+            b0 += other.b0;
+            b1 += other.b1;
+            b2 += other.b2;
+            c += other.c;
+            weight += other.weight;
+        }
+
+        // Weighted average squared distance to the planes.
+        double error(const Vec3& p) const {
+            if (weight <= 0.0)
+                return 0.0;
+            double rx = a00 * p.x + a01 * p.y + a02 * p.z;
+            double ry = a01 * p.x + a11 * p.y + a12 * p.z;
+            double rz = a02 * p.x + a12 * p.y + a22 * p.z;
+            double result = rx * p.x + ry * p.y + rz * p.z + 2.0 * (b0 * p.x + b1 * p.y + b2 * p.z) + c;
+            return std::max(0.0, result / weight);
+        }
+    };
+
+    struct PositionHasher {
+        size_t operator()(const std::array<uint32_t, 3>& key) const {
+            return ((size_t)key[0] * 73856093) ^ ((size_t)key[1] * 19349663) ^ ((size_t)key[2] * 83492791);
+        }
+    };
+
+    inline uint64_t edgeKey(uint32_t a, uint32_t b) {
+        return ((uint64_t)a << 32) | b;
+    }
+
+    struct Collapse {
+        uint32_t from = 0;
+        uint32_t to = 0;
+        // Geometric error plus attribute penalties, used for ordering.
+        double cost = 0.0;
+        // Geometric error only, used for the error limit and reported error.
+        double error = 0.0;
+    };
+
+    class Simplifier {
+    public:
+        Simplifier(const std::vector<uint32_t>& indices, const uint8_t* vertexData, size_t vertexCount, size_t stride, int skinOffset)
+            : vertexData(vertexData), stride(stride), skinOffset(skinOffset), indices(indices) {
+            positions.resize(vertexCount);
+            for (size_t v = 0; v < vertexCount; ++v) {
+                float p[3];
+                memcpy(p, vertexData + v * stride, sizeof(p));
+                positions[v] = { p[0], p[1], p[2] };
+            }
+
+            buildWedges();
+            classifyVertices();
+            buildQuadrics();
+
+            // Errors are reported relative to the size of the mesh
+            Vec3 minimum = positions.empty() ? Vec3() : positions[indices.empty() ? 0 : indices[0]];
+            Vec3 maximum = minimum;
+            for (uint32_t index : indices) {
+                const Vec3& p = positions[index];
+                minimum = { std::min(minimum.x, p.x), std::min(minimum.y, p.y), std::min(minimum.z, p.z) };
+                maximum = { std::max(maximum.x, p.x), std::max(maximum.y, p.y), std::max(maximum.z, p.z) };
+            }
+            extent = std::max({ maximum.x - minimum.x, maximum.y - minimum.y, maximum.z - minimum.z });
+            if (extent <= 0.0)
+                extent = 1.0;
+        }
+
+        // Collapse edges until the triangle count reaches targetTriangleCount or no collapse fits within maxError.
+        void simplify(size_t targetTriangleCount, float maxError) {
+            double errorLimit = (double)maxError * extent;
+            errorLimit *= errorLimit;
+
+            while (indices.size() / 3 > targetTriangleCount) {
+                if (runPass(targetTriangleCount, errorLimit) == 0)
+                    break;
+            }
+        }
+
+        const std::vector<uint32_t>& currentIndices() const { return indices; }
+
+        float relativeError() const { return (float)(sqrt(maximumError) / extent); }
+
+    private:
+        const uint8_t* vertexData;
+        size_t stride;
+        int skinOffset;
+        std::vector<uint32_t> indices;
+
+        std::vector<Vec3> positions;
+        // The first vertex with the same position, quadrics are stored for that vertex.
+        std::vector<uint32_t> positionIds;
+        // Circular list linking all vertices with the same position.
+        std::vector<uint32_t> wedges;
+        std::vector<VertexKind> kinds;
+        std::vector<Quadric> quadrics;
+        double extent = 1.0;
+        double maximumError = 0.0;
+
+        void buildWedges() {
+            size_t vertexCount = positions.size();
+            positionIds.resize(vertexCount);
+            wedges.resize(vertexCount);
+            std::unordered_map<std::array<uint32_t, 3>, uint32_t, PositionHasher> firstVertex;
+            for (size_t v = 0; v < vertexCount; ++v) {
+                std::array<uint32_t, 3> key;
+                memcpy(key.data(), vertexData + v * stride, sizeof(key));
+                auto it = firstVertex.find(key);
+                if (it == firstVertex.end()) {
+                    firstVertex[key] = (uint32_t)v;
+                    positionIds[v] = (uint32_t)v;
+                    wedges[v] = (uint32_t)v;
+                } else {
+                    // Insert into the circular list after the first vertex
+                    positionIds[v] = it->second;
+                    wedges[v] = wedges[it->second];
+                    wedges[it->second] = (uint32_t)v;
+                }
+            }
+        }
+
+        size_t wedgeCount(uint32_t v) const {
+            size_t count = 1;
+            for (uint32_t w = wedges[v]; w != v; w = wedges[w])
+                ++count;
+            return count;
+        }
+
+        // Half edges between positions, an edge is a border if the opposite half edge does not exist.
+        std::unordered_set<uint64_t> buildHalfEdges() const {
+            std::unordered_set<uint64_t> halfEdges;
+            halfEdges.reserve(indices.size());
+            for (size_t i = 0; i < indices.size(); i += 3) {
+                for (size_t k = 0; k < 3; ++k)
+                    halfEdges.insert(edgeKey(positionIds[indices[i + k]], positionIds[indices[i + (k + 1) % 3]]));
+            }
+            return halfEdges;
+        }
+
+        void classifyVertices() {
+            size_t vertexCount = positions.size();
+            std::unordered_set<uint64_t> halfEdges = buildHalfEdges();
+            std::vector<uint32_t> openOutgoing(vertexCount, 0);
+            std::vector<uint32_t> openIncoming(vertexCount, 0);
+            for (uint64_t edge : halfEdges) {
+                uint32_t a = (uint32_t)(edge >> 32);
+                uint32_t b = (uint32_t)edge;
+                if (halfEdges.find(edgeKey(b, a)) == halfEdges.end()) {
+                    openOutgoing[a]++;
+                    openIncoming[b]++;
+                }
+            }
+
+            kinds.resize(vertexCount);
+            for (size_t v = 0; v < vertexCount; ++v) {
+                uint32_t id = positionIds[v];
+                size_t count = wedgeCount((uint32_t)v);
+                bool isOpen = openOutgoing[id] != 0 || openIncoming[id] != 0;
+                if (count == 1 && !isOpen)
+                    kinds[v] = VertexKind::Manifold;
+                else if (count == 1 && openOutgoing[id] == 1 && openIncoming[id] == 1)
+                    kinds[v] = VertexKind::Border;
+                else if (count == 2 && !isOpen)
+                    kinds[v] = VertexKind::Seam;
+                else
+                    kinds[v] = VertexKind::Locked;
+            }
+        }
+
+        void buildQuadrics() {
+            quadrics.assign(positions.size(), {});
+            std::unordered_set<uint64_t> halfEdges = buildHalfEdges();
+            for (size_t i = 0; i < indices.size(); i += 3) {
+                const Vec3& p0 = positions[indices[i]];
+                const Vec3& p1 = positions[indices[i + 1]];
+                const Vec3& p2 = positions[indices[i + 2]];
+                Vec3 n = cross(sub(p1, p0), sub(p2, p0));
+                double length = sqrt(dot(n, n));
+                if (length <= 0.0)
+                    continue;
+                n = { n.x / length, n.y / length, n.z / length };
+
+                // Area weighted triangle plane
+                double area = length * 0.5;
+                for (size_t k = 0; k < 3; ++k)
+                    quadrics[positionIds[indices[i + k]]].addPlane(n, -dot(n, p0), area);
+
+                // Plane through open edges, perpendicular to the triangle, keeps borders in place
+                for (size_t k = 0; k < 3; ++k) {
+                    uint32_t a = positionIds[indices[i + k]];
+                    uint32_t b = positionIds[indices[i + (k + 1) % 3]];
+                    if (halfEdges.find(edgeKey(b, a)) != halfEdges.end())
+                        continue;
+                    Vec3 edge = sub(positions[b], positions[a]);
+                    Vec3 m = cross(edge, n);
+                    double edgeLength = sqrt(dot(m, m));
+                    if (edgeLength <= 0.0)
+                        continue;
+                    m = { m.x / edgeLength, m.y / edgeLength, m.z / edgeLength };
+                    double d = -dot(m, positions[a]);
+                    quadrics[a].addPlane(m, d, dot(edge, edge) * BORDER_WEIGHT);
+                    quadrics[b].addPlane(m, d, dot(edge, edge) * BORDER_WEIGHT);
+                }
+            }
+        }
+
+        // Sum of absolute weight differences over all joints that influence either vertex, 0 when the skinning is identical.
+        double skinDistance(uint32_t a, uint32_t b) const {
+            uint32_t jointsA[8];
+            uint32_t jointsB[8];
+            float weightsA[8];
+            float weightsB[8];
+            memcpy(jointsA, vertexData + a * stride + skinOffset, sizeof(jointsA));
+            memcpy(weightsA, vertexData + a * stride + skinOffset + sizeof(jointsA), sizeof(weightsA));
+            memcpy(jointsB, vertexData + b * stride + skinOffset, sizeof(jointsB));
+            memcpy(weightsB, vertexData + b * stride + skinOffset + sizeof(jointsB), sizeof(weightsB));
+
+            double result = 0.0;
+            for (size_t i = 0; i < 8; ++i) {
+                if (weightsA[i] == 0.0f)
+                    continue;
+                float other = 0.0f;
+                for (size_t j = 0; j < 8; ++j)
+                    if (jointsB[j] == jointsA[i])
+                        other += weightsB[j];
+                result += fabs(weightsA[i] - other);
+            }
+            for (size_t j = 0; j < 8; ++j) {
+                if (weightsB[j] == 0.0f)
+                    continue;
+                bool shared = false;
+                for (size_t i = 0; i < 8; ++i)
+                    shared = shared || (jointsA[i] == jointsB[j] && weightsA[i] != 0.0f);
+                if (!shared)
+                    result += weightsB[j];
+            }
+            return result;
+        }
+
+        bool canCollapse(uint32_t from, uint32_t to, const std::unordered_set<uint64_t>& halfEdges) const {
+            uint32_t fromId = positionIds[from];
+            uint32_t toId = positionIds[to];
+            if (fromId == toId)
+                return false;
+            switch (kinds[from]) {
+            case VertexKind::Manifold:
+                return true;
+            case VertexKind::Border:
+                // Only along the open edge
+                return halfEdges.find(edgeKey(toId, fromId)) == halfEdges.end() || halfEdges.find(edgeKey(fromId, toId)) == halfEdges.end();
+            case VertexKind::Seam:
+                // Only towards another vertex on the seam, we verify the other half follows along when collapsing
+                return kinds[to] == VertexKind::Seam || kinds[to] == VertexKind::Locked;
+            default:
+                return false;
+            }
+        }
+
+        Collapse evaluate(uint32_t from, uint32_t to) const {
+            Quadric q = quadrics[positionIds[from]];
+            q.add(quadrics[positionIds[to]]);
+            Collapse result = { from, to, 0.0, q.error(positions[to]) };
+            result.cost = result.error;
+            if (skinOffset >= 0) {
+                double penalty = skinDistance(from, to) * SKIN_WEIGHT * extent;
+                result.cost += penalty * penalty;
+            }
+            return result;
+        }
+
+        // Returns false if moving from onto to would flip or degenerate any triangle that survives the collapse.
+        bool preservesOrientation(uint32_t from, uint32_t to, const TT_FBX::TriangleAdjacency& adjacency, const std::vector<uint32_t>& remap) const {
+            uint32_t toId = positionIds[to];
+            for (uint32_t i = adjacency.offsets[from]; i < adjacency.offsets[from + 1]; ++i) {
+                uint32_t t = adjacency.triangles[i];
+                uint32_t v[3] = { remap[indices[t * 3]], remap[indices[t * 3 + 1]], remap[indices[t * 3 + 2]] };
+                // Triangles containing the edge disappear
+                if (positionIds[v[0]] == toId || positionIds[v[1]] == toId || positionIds[v[2]] == toId)
+                    continue;
+                Vec3 before = cross(sub(positions[v[1]], positions[v[0]]), sub(positions[v[2]], positions[v[0]]));
+                for (uint32_t& vertex : v)
+                    if (vertex == from)
+                        vertex = to;
+                Vec3 after = cross(sub(positions[v[1]], positions[v[0]]), sub(positions[v[2]], positions[v[0]]));
+                if (dot(before, after) < MIN_NORMAL_DOT * sqrt(dot(before, before) * dot(after, after)) || dot(after, after) <= 0.0)
+                    return false;
+            }
+            return true;
+        }
+
+        // Find the vertex with the same position as to that shares a triangle with from.
+        int64_t findSeamPartner(uint32_t from, uint32_t to, const TT_FBX::TriangleAdjacency& adjacency) const {
+            uint32_t toId = positionIds[to];
+            for (uint32_t i = adjacency.offsets[from]; i < adjacency.offsets[from + 1]; ++i) {
+                uint32_t t = adjacency.triangles[i];
+                for (size_t k = 0; k < 3; ++k)
+                    if (positionIds[indices[t * 3 + k]] == toId)
+                        return indices[t * 3 + k];
+            }
+            return -1;
+        }
+
+        // Perform as many non-overlapping collapses as possible, cheapest first. Returns the number of collapses.
+        size_t runPass(size_t targetTriangleCount, double errorLimit) {
+            size_t vertexCount = positions.size();
+            std::unordered_set<uint64_t> halfEdges = buildHalfEdges();
+            TT_FBX::TriangleAdjacency adjacency = TT_FBX::buildTriangleAdjacency(indices, vertexCount);
+
+            // Pick the cheapest direction of every edge
+            std::vector<Collapse> candidates;
+            candidates.reserve(indices.size());
+            for (size_t i = 0; i < indices.size(); i += 3) {
+                for (size_t k = 0; k < 3; ++k) {
+                    uint32_t a = indices[i + k];
+                    uint32_t b = indices[i + (k + 1) % 3];
+                    bool forward = canCollapse(a, b, halfEdges);
+                    bool backward = canCollapse(b, a, halfEdges);
+                    if (!forward && !backward)
+                        continue;
+                    Collapse ab = forward ? evaluate(a, b) : Collapse();
+                    Collapse ba = backward ? evaluate(b, a) : Collapse();
+                    candidates.push_back(!backward || (forward && ab.cost <= ba.cost) ? ab : ba);
+                }
+            }
+            std::sort(candidates.begin(), candidates.end(), [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+            // Each collapse removes about 2 triangles
+            size_t triangleCount = indices.size() / 3;
+            size_t collapseGoal = (triangleCount - targetTriangleCount) / 2 + 1;
+
+            std::vector<uint32_t> remap(vertexCount);
+            for (size_t v = 0; v < vertexCount; ++v)
+                remap[v] = (uint32_t)v;
+            // Positions touched this pass, the quadrics and adjacency of those are out of date
+            std::vector<bool> locked(vertexCount, false);
+            size_t collapses = 0;
+
+            for (const Collapse& collapse : candidates) {
+                if (collapses >= collapseGoal)
+                    break;
+                if (collapse.error > errorLimit)
+                    continue;
+                uint32_t fromId = positionIds[collapse.from];
+                uint32_t toId = positionIds[collapse.to];
+                if (locked[fromId] || locked[toId])
+                    continue;
+
+                // Seams move both halves, each onto the matching half of the target
+                uint32_t from[2] = { collapse.from, 0 };
+                uint32_t to[2] = { collapse.to, 0 };
+                size_t moveCount = 1;
+                if (kinds[collapse.from] == VertexKind::Seam) {
+                    from[1] = wedges[collapse.from];
+                    int64_t partner = findSeamPartner(from[1], collapse.to, adjacency);
+                    if (partner < 0)
+                        continue;
+                    to[1] = (uint32_t)partner;
+                    moveCount = 2;
+                }
+
+                bool valid = true;
+                for (size_t i = 0; i < moveCount && valid; ++i)
+                    valid = preservesOrientation(from[i], to[i], adjacency, remap);
+                if (!valid)
+                    continue;
+
+                for (size_t i = 0; i < moveCount; ++i)
+                    remap[from[i]] = to[i];
+                quadrics[toId].add(quadrics[fromId]);
+                locked[fromId] = true;
+                locked[toId] = true;
+                maximumError = std::max(maximumError, collapse.error);
+                ++collapses;
+            }
+
+            if (collapses == 0)
+                return 0;
+
+            // Apply the collapses and drop triangles that became degenerate
+            size_t write = 0;
+            for (size_t i = 0; i < indices.size(); i += 3) {
+                uint32_t a = remap[indices[i]];
+                uint32_t b = remap[indices[i + 1]];
+                uint32_t c = remap[indices[i + 2]];
+                if (positionIds[a] == positionIds[b] || positionIds[b] == positionIds[c] || positionIds[a] == positionIds[c])
+                    continue;
+                indices[write++] = a;
+                indices[write++] = b;
+                indices[write++] = c;
+            }
+            indices.resize(write);
+            return collapses;
+        }
+    };
+}
+
+namespace TT_FBX {
+    std::vector<SimplifiedLod> buildLods(const std::vector<uint32_t>& indices, const uint8_t* vertexData, size_t vertexCount, size_t stride, int skinOffset, const std::vector<LodTarget>& targets) {
+        std::vector<SimplifiedLod> result;
+        if (indices.empty() || vertexCount == 0)
+            return result;
+
+        Simplifier simplifier(indices, vertexData, vertexCount, stride, skinOffset);
+        size_t triangleCount = indices.size() / 3;
+        for (const LodTarget& target : targets) {
+            simplifier.simplify((size_t)(std::max(0.0f, target.ratio) * triangleCount), target.maxError);
+            result.push_back({ simplifier.currentIndices(), simplifier.relativeError() });
+        }
+        return result;
+    }
+}
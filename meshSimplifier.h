@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace TT_FBX {
+    // Describes when to stop simplifying for one LOD.
+    struct LodTarget {
+        // Fraction of the original triangle count to reduce to.
+        float ratio = 0.5f;
+        // Stop before exceeding this error, relative to the largest dimension of the mesh bounding box.
+        float maxError = 1.0f;
+    };
+
+    struct SimplifiedLod {
+        std::vector<uint32_t> indices;
+        // Largest deviation from the original surface, relative to the largest dimension of the mesh bounding box.
+        float error = 0.0f;
+    };
+
+    // Build a chain of LODs with quadric error edge collapses, each LOD continues from the previous one.
+    // The LODs only reference existing vertices so they share the vertex buffer of the input.
+    //
+    // The vertex data must start with a float3 position. Vertices that share a position but differ in other attributes
+    // (UV seams, hard normals) only collapse along the seam so the seam is preserved, open borders only collapse along the border.
+    // skinOffset is the byte offset of 8 uint32 joint indices followed by 8 float weights, or -1 for static meshes,
+    // collapses between vertices with different skin weights are penalized so they happen last.
+    std::vector<SimplifiedLod> buildLods(const std::vector<uint32_t>& indices, const uint8_t* vertexData, size_t vertexCount, size_t stride, int skinOffset, const std::vector<LodTarget>& targets);
+}
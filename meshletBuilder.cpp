@@ -0,0 +1,199 @@
+#include <fbxsdk.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "meshletBuilder.h"
+#include "meshOptimizer.h"
+
+namespace {
+    // Marks a vertex that is not part of the meshlet being built.
+    constexpr uint16_t NOT_IN_MESHLET = 0xFFFF;
+
+    struct Vec3 {
+        float x = 0.0f;
+        float y = 0.0f;
+        float z = 0.0f;
+    };
+
+    inline Vec3 readPosition(const uint8_t* vertexData, size_t stride, uint32_t index) {
+        Vec3 result;
+        memcpy(&result, vertexData + index * stride, sizeof(Vec3));
+        return result;
+    }
+
+    inline Vec3 sub(const Vec3& a, const Vec3& b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+    inline float dot(const Vec3& a, const Vec3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+    inline Vec3 cross(const Vec3& a, const Vec3& b) { return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; }
+
+    // Fill in the bounding sphere and normal cone of a finished meshlet.
+    // The cone follows the usual convention: the meshlet is backfacing when
+    // dot(normalize(coneApex - cameraPosition), coneAxis) >= coneCutoff.
+    void computeMeshletBounds(Meshlet& meshlet, const uint32_t* meshletVertices, const uint32_t* meshletTriangles, const uint8_t* vertexData, size_t stride) {
+        // Sphere around the center of the bounding box
+        Vec3 minimum = readPosition(vertexData, stride, meshletVertices[0]);
+        Vec3 maximum = minimum;
+        for (uint32_t i = 1; i < meshlet.vertexCount; ++i) {
+            Vec3 p = readPosition(vertexData, stride, meshletVertices[i]);
+            minimum = { std::min(minimum.x, p.x), std::min(minimum.y, p.y), std::min(minimum.z, p.z) };
+            maximum = { std::max(maximum.x, p.x), std::max(maximum.y, p.y), std::max(maximum.z, p.z) };
+        }
+        Vec3 center = { (minimum.x + maximum.x) * 0.5f, (minimum.y + maximum.y) * 0.5f, (minimum.z + maximum.z) * 0.5f };
+        float radiusSquared = 0.0f;
+        for (uint32_t i = 0; i < meshlet.vertexCount; ++i) {
+            Vec3 d = sub(readPosition(vertexData, stride, meshletVertices[i]), center);
+            radiusSquared = std::max(radiusSquared, dot(d, d));
+        }
+        meshlet.center[0] = center.x;
+        meshlet.center[1] = center.y;
+        meshlet.center[2] = center.z;
+        meshlet.radius = sqrtf(radiusSquared);
+
+        // Unit triangle normals, degenerate triangles don't constrain the cone
+        std::vector<Vec3> normals;
+        std::vector<Vec3> corners;
+        Vec3 axis;
+        for (uint32_t t = 0; t < meshlet.triangleCount; ++t) {
+            uint32_t packed = meshletTriangles[t];
+            Vec3 a = readPosition(vertexData, stride, meshletVertices[packed & 0xFF]);
+            Vec3 b = readPosition(vertexData, stride, meshletVertices[(packed >> 8) & 0xFF]);
+            Vec3 c = readPosition(vertexData, stride, meshletVertices[(packed >> 16) & 0xFF]);
+            Vec3 n = cross(sub(b, a), sub(c, a));
+            float length = sqrtf(dot(n, n));
+            if (length <= 0.0f)
+                continue;
+            n = { n.x / length, n.y / length, n.z / length };
+            normals.push_back(n);
+            corners.push_back(a);
+            axis = { axis.x + n.x, axis.y + n.y, axis.z + n.z };
+        }
+
+        // Without a meaningful cone we store a cutoff that never culls
+        meshlet.coneApex[0] = center.x;
+        meshlet.coneApex[1] = center.y;
+        meshlet.coneApex[2] = center.z;
+        meshlet.coneAxis[0] = meshlet.coneAxis[1] = meshlet.coneAxis[2] = 0.0f;
+        meshlet.coneCutoff = 1.0f;
+
+        float axisLength = sqrtf(dot(axis, axis));
+        if (normals.empty() || axisLength <= 0.0f)
+            return;
+        axis = { axis.x / axisLength, axis.y / axisLength, axis.z / axisLength };
+
+        float minimumDot = 1.0f;
+        for (const Vec3& n : normals)
+            minimumDot = std::min(minimumDot, dot(axis, n));
+        // Cones wider than ~85 degrees are practically never culled, not worth the test
+        if (minimumDot <= 0.1f)
+            return;
+
+        // Move the apex back along the axis until every triangle plane is in front of it
+        float maximumT = 0.0f;
+        for (size_t i = 0; i < normals.size(); ++i) {
+            float t = dot(sub(center, corners[i]), normals[i]) / dot(axis, normals[i]);
+            maximumT = std::max(maximumT, t);
+        }
+
+        meshlet.coneApex[0] = center.x - axis.x * maximumT;
+        meshlet.coneApex[1] = center.y - axis.y * maximumT;
+        meshlet.coneApex[2] = center.z - axis.z * maximumT;
+        meshlet.coneAxis[0] = axis.x;
+        meshlet.coneAxis[1] = axis.y;
+        meshlet.coneAxis[2] = axis.z;
+        meshlet.coneCutoff = sqrtf(1.0f - minimumDot * minimumDot);
+    }
+}
+
+namespace TT_FBX {
+    MeshletBuffers buildMeshlets(const std::vector<uint32_t>& indices, const uint8_t* vertexData, size_t vertexCount, size_t stride, uint32_t maxVertices, uint32_t maxTriangles) {
+        MeshletBuffers result;
+        size_t triangleCount = indices.size() / 3;
+        if (triangleCount == 0 || vertexCount == 0)
+            return result;
+
+        // Micro indices are 8 bit, and a meshlet must fit at least one triangle
+        maxVertices = std::min(std::max(maxVertices, 3u), 256u);
+        maxTriangles = std::max(maxTriangles, 1u);
+
+        TriangleAdjacency adjacency = buildTriangleAdjacency(indices, vertexCount);
+        std::vector<uint32_t> liveTriangles = adjacency.counts;
+        std::vector<bool> emitted(triangleCount, false);
+        std::vector<uint16_t> localIndex(vertexCount, NOT_IN_MESHLET);
+        size_t seedCursor = 0;
+
+        Meshlet current;
+
+        auto finishMeshlet = [&]() {
+            if (current.triangleCount == 0)
+                return;
+            computeMeshletBounds(current, &result.vertices[current.vertexOffset], &result.triangles[current.triangleOffset], vertexData, stride);
+            for (uint32_t i = 0; i < current.vertexCount; ++i)
+                localIndex[result.vertices[current.vertexOffset + i]] = NOT_IN_MESHLET;
+            result.meshlets.push_back(current);
+            current = {};
+            current.vertexOffset = (uint32_t)result.vertices.size();
+            current.triangleOffset = (uint32_t)result.triangles.size();
+        };
+
+        auto newVertexCount = [&](uint32_t t) {
+            return (uint32_t)(localIndex[indices[t * 3]] == NOT_IN_MESHLET) +
+                (uint32_t)(localIndex[indices[t * 3 + 1]] == NOT_IN_MESHLET) +
+                (uint32_t)(localIndex[indices[t * 3 + 2]] == NOT_IN_MESHLET);
+        };
+
+        while (true) {
+            if (current.triangleCount == maxTriangles)
+                finishMeshlet();
+
+            // Grow over the vertices already in the meshlet. Prefer triangles that add the least new vertices,
+            // then triangles whose vertices have the least remaining triangles so we close off vertices and don't need to duplicate them later.
+            int64_t best = -1;
+            uint32_t bestNewVertices = 4;
+            uint32_t bestLive = ~0u;
+            for (uint32_t i = 0; i < current.vertexCount; ++i) {
+                uint32_t v = result.vertices[current.vertexOffset + i];
+                for (uint32_t j = adjacency.offsets[v]; j < adjacency.offsets[v + 1]; ++j) {
+                    uint32_t t = adjacency.triangles[j];
+                    if (emitted[t])
+                        continue;
+                    uint32_t newVertices = newVertexCount(t);
+                    if (current.vertexCount + newVertices > maxVertices)
+                        continue;
+                    uint32_t live = liveTriangles[indices[t * 3]] + liveTriangles[indices[t * 3 + 1]] + liveTriangles[indices[t * 3 + 2]];
+                    if (newVertices < bestNewVertices || (newVertices == bestNewVertices && live < bestLive)) {
+                        best = t;
+                        bestNewVertices = newVertices;
+                        bestLive = live;
+                    }
+                }
+            }
+
+            // Nothing connected fits, start a new meshlet from the next triangle in input order
+            if (best < 0) {
+                finishMeshlet();
+                while (seedCursor < triangleCount && emitted[seedCursor])
+                    ++seedCursor;
+                if (seedCursor == triangleCount)
+                    break;
+                best = (int64_t)seedCursor;
+            }
+
+            // Add the triangle
+            uint32_t packed = 0;
+            for (uint32_t k = 0; k < 3; ++k) {
+                uint32_t v = indices[best * 3 + k];
+                if (localIndex[v] == NOT_IN_MESHLET) {
+                    localIndex[v] = (uint16_t)current.vertexCount++;
+                    result.vertices.push_back(v);
+                }
+                liveTriangles[v]--;
+                packed |= (uint32_t)localIndex[v] << (k * 8);
+            }
+            result.triangles.push_back(packed);
+            current.triangleCount++;
+            emitted[best] = true;
+        }
+
+        return result;
+    }
+}
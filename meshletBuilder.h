@@ -0,0 +1,19 @@
+#pragma once
+
+#include <vector>
+
+#include "meshParser.h"
+
+namespace TT_FBX {
+    // Meshlets of a single submesh, see MeshData for how these relate.
+    struct MeshletBuffers {
+        std::vector<Meshlet> meshlets;
+        std::vector<uint32_t> vertices;
+        std::vector<uint32_t> triangles;
+    };
+
+    // Split a triangle list into meshlets with at most maxVertices unique vertices and maxTriangles triangles each.
+    // Triangles are grown from a seed over shared vertices, so feeding a cache optimized index buffer gives the best seeds.
+    // The vertex data must start with a float3 position, which is used to compute the culling bounds.
+    MeshletBuffers buildMeshlets(const std::vector<uint32_t>& indices, const uint8_t* vertexData, size_t vertexCount, size_t stride, uint32_t maxVertices, uint32_t maxTriangles);
+}
@@ -0,0 +1,79 @@
+#include <fbxsdk.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "morphTargetBuilder.h"
+
+namespace {
+    // Deltas smaller than this are considered noise from the DCC and don't move the vertex.
+    constexpr float DELTA_EPSILON = 1e-6f;
+
+    inline bool isSignificant(const float* delta) {
+        return fabsf(delta[0]) > DELTA_EPSILON || fabsf(delta[1]) > DELTA_EPSILON || fabsf(delta[2]) > DELTA_EPSILON;
+    }
+
+    inline void normalize(float* v) {
+        float length = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+        if (length <= 1e-20f)
+            return;
+        for (int i = 0; i < 3; ++i)
+            v[i] /= length;
+    }
+
+    // Quantize to the full int16 range, returns the scale that turns an integer back into a float.
+    float quantize(const std::vector<float>& values, std::vector<int16_t>& result) {
+        float largest = 0.0f;
+        for (float value : values)
+            largest = std::max(largest, fabsf(value));
+        result.resize(values.size());
+        if (largest == 0.0f) {
+            std::fill(result.begin(), result.end(), (int16_t)0);
+            return 0.0f;
+        }
+        float toInteger = 32767.0f / largest;
+        for (size_t i = 0; i < values.size(); ++i)
+            result[i] = (int16_t)std::max(-32767.0f, std::min(32767.0f, roundf(values[i] * toInteger)));
+        return largest / 32767.0f;
+    }
+}
+
+namespace TT_FBX {
+    MorphTargetBuffers buildMorphTarget(const MorphSource& source, const MorphBase& base, bool quantizeDeltas) {
+        MorphTargetBuffers result;
+        size_t controlPointCount = source.positionDeltas.size() / 3;
+        for (uint32_t vertex = 0; vertex < (uint32_t)base.vertexCount; ++vertex) {
+            uint32_t corner = base.sourceCorners[vertex];
+            uint32_t controlPoint = base.cornerControlPoints[corner];
+
+            // Targets may have fewer points than the mesh if it was edited after the target was made
+            float positionDelta[3] = {};
+            if (controlPoint < controlPointCount)
+                memcpy(positionDelta, source.positionDeltas.data() + controlPoint * 3, sizeof(positionDelta));
+
+            float normalDelta[3] = {};
+            if (base.normals && !source.normals.empty()) {
+                float baseNormal[3];
+                memcpy(baseNormal, base.normals + vertex * base.normalStride, sizeof(baseNormal));
+                normalize(baseNormal);
+                for (int i = 0; i < 3; ++i)
+                    normalDelta[i] = source.normals[corner * 3 + i] - baseNormal[i];
+            }
+
+            if (!isSignificant(positionDelta) && !isSignificant(normalDelta))
+                continue;
+            result.vertices.push_back(vertex);
+            result.positionDeltas.insert(result.positionDeltas.end(), positionDelta, positionDelta + 3);
+            if (base.normals)
+                result.normalDeltas.insert(result.normalDeltas.end(), normalDelta, normalDelta + 3);
+        }
+
+        if (quantizeDeltas) {
+            result.positionScale = quantize(result.positionDeltas, result.quantizedPositionDeltas);
+            result.normalScale = quantize(result.normalDeltas, result.quantizedNormalDeltas);
+            result.positionDeltas = {};
+            result.normalDeltas = {};
+        }
+        return result;
+    }
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace TT_FBX {
+    // A blend shape target resolved against its base mesh.
+    struct MorphSource {
+        // 3 floats per control point, target position minus base position.
+        std::vector<float> positionDeltas;
+        // 3 floats per polygon vertex, the normals of the target. Empty if the target has none.
+        std::vector<float> normals;
+    };
+
+    // Sparse deltas of one target on one vertex buffer, see MorphTarget.
+    struct MorphTargetBuffers {
+        std::vector<uint32_t> vertices;
+        std::vector<float> positionDeltas;
+        std::vector<float> normalDeltas;
+        std::vector<int16_t> quantizedPositionDeltas;
+        std::vector<int16_t> quantizedNormalDeltas;
+        float positionScale = 0.0f;
+        float normalScale = 0.0f;
+    };
+
+    // The vertex buffer a target is applied to. Every vertex remembers the polygon vertex (corner) it was read from.
+    struct MorphBase {
+        size_t vertexCount = 0;
+        // Corner per vertex.
+        const uint32_t* sourceCorners = nullptr;
+        // Control point per corner.
+        const uint32_t* cornerControlPoints = nullptr;
+        // Strided float3 vertex normals, nullptr if the vertices have no normals.
+        const uint8_t* normals = nullptr;
+        size_t normalStride = 0;
+    };
+
+    // Collect the vertices the target moves, with their position and normal deltas. Vertices whose deltas are all
+    // below a small epsilon are left out. When the target has no normals of its own the normal deltas are 0.
+    // With quantize, the deltas are stored as 16 bit integers scaled to the largest component of the target instead of floats.
+    MorphTargetBuffers buildMorphTarget(const MorphSource& source, const MorphBase& base, bool quantize);
+}
@@ -0,0 +1,165 @@
+#include <fbxsdk.h>
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+#include "common.h"
+#include "normalGenerator.h"
+
+namespace {
+    struct Vec3 {
+        float x = 0.0f;
+        float y = 0.0f;
+        float z = 0.0f;
+    };
+
+    inline Vec3 add(const Vec3& a, const Vec3& b) { return { a.x + b.x, a.y + b.y, a.z + b.z }; }
+    inline Vec3 sub(const Vec3& a, const Vec3& b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+    inline Vec3 scale(const Vec3& a, float s) { return { a.x * s, a.y * s, a.z * s }; }
+    inline float dot(const Vec3& a, const Vec3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+
+    inline bool normalize(Vec3& a) {
+        float length = sqrtf(dot(a, a));
+        if (length <= 1e-20f)
+            return false;
+        a = scale(a, 1.0f / length);
+        return true;
+    }
+
+    inline Vec3 readVec3(const std::vector<float>& data, uint32_t corner) {
+        return { data[corner * 3], data[corner * 3 + 1], data[corner * 3 + 2] };
+    }
+
+    // Union-find over corners, corners in the same set end up with the same normal.
+    struct CornerSets {
+        std::vector<uint32_t> parents;
+
+        explicit CornerSets(size_t count) : parents(count) {
+            for (size_t i = 0; i < count; ++i)
+                parents[i] = (uint32_t)i;
+        }
+
+        uint32_t find(uint32_t corner) {
+            while (parents[corner] != corner) {
+                parents[corner] = parents[parents[corner]];
+                corner = parents[corner];
+            }
+            return corner;
+        }
+
+        void merge(uint32_t a, uint32_t b) {
+            a = find(a);
+            b = find(b);
+            if (a != b)
+                parents[std::max(a, b)] = std::min(a, b);
+        }
+    };
+}
+
+namespace TT_FBX {
+    std::vector<float> generateNormals(const CornerGeometry& geometry, const NormalSmoothing& smoothing) {
+        size_t polygonCount = geometry.polygonOffsets.empty() ? 0 : geometry.polygonOffsets.size() - 1;
+        size_t cornerCount = geometry.controlPoints.size();
+
+        // Polygon normals with Newell's method, which also works for non-planar polygons,
+        // and the angle of each corner within its polygon.
+        std::vector<Vec3> polygonNormals(polygonCount);
+        std::vector<float> cornerAngles(cornerCount, 0.0f);
+        TT_FBX::parallelFor(polygonCount, [&](size_t polygon) {
+            uint32_t first = geometry.polygonOffsets[polygon];
+            uint32_t last = geometry.polygonOffsets[polygon + 1];
+            if (last - first < 3)
+                return;
+            Vec3 normal;
+            for (uint32_t corner = first; corner < last; ++corner) {
+                Vec3 a = readVec3(geometry.positions, corner);
+                Vec3 b = readVec3(geometry.positions, corner + 1 < last ? corner + 1 : first);
+                normal = add(normal, { (a.y - b.y) * (a.z + b.z), (a.z - b.z) * (a.x + b.x), (a.x - b.x) * (a.y + b.y) });
+            }
+            normalize(normal);
+            polygonNormals[polygon] = normal;
+
+            for (uint32_t corner = first; corner < last; ++corner) {
+                Vec3 p = readVec3(geometry.positions, corner);
+                Vec3 previous = sub(readVec3(geometry.positions, corner > first ? corner - 1 : last - 1), p);
+                Vec3 next = sub(readVec3(geometry.positions, corner + 1 < last ? corner + 1 : first), p);
+                if (normalize(previous) && normalize(next))
+                    cornerAngles[corner] = acosf(std::min(1.0f, std::max(-1.0f, dot(previous, next))));
+            }
+        });
+
+        // Find polygons that share an edge and join their corners on either end when the edge is smooth.
+        std::vector<uint32_t> cornerPolygon(cornerCount);
+        for (size_t polygon = 0; polygon < polygonCount; ++polygon) {
+            for (uint32_t corner = geometry.polygonOffsets[polygon]; corner < geometry.polygonOffsets[polygon + 1]; ++corner)
+                cornerPolygon[corner] = (uint32_t)polygon;
+        }
+
+        float minimumDot = cosf(smoothing.creaseAngle * 3.14159265f / 180.0f);
+        auto isSmooth = [&](uint32_t cornerA, uint32_t cornerB) {
+            uint32_t polygonA = cornerPolygon[cornerA];
+            uint32_t polygonB = cornerPolygon[cornerB];
+            if (!smoothing.polygonGroups.empty())
+                return (smoothing.polygonGroups[polygonA] & smoothing.polygonGroups[polygonB]) != 0;
+            if (!smoothing.smoothEdges.empty())
+                return smoothing.smoothEdges[cornerA] != 0 && smoothing.smoothEdges[cornerB] != 0;
+            return dot(polygonNormals[polygonA], polygonNormals[polygonB]) >= minimumDot;
+        };
+
+        // Keyed by the sorted control points of the edge, the value is the first corner that starts this edge.
+        CornerSets sets(cornerCount);
+        std::unordered_map<uint64_t, uint32_t> edges;
+        edges.reserve(cornerCount);
+        for (size_t polygon = 0; polygon < polygonCount; ++polygon) {
+            uint32_t first = geometry.polygonOffsets[polygon];
+            uint32_t last = geometry.polygonOffsets[polygon + 1];
+            if (last - first < 3)
+                continue;
+            for (uint32_t corner = first; corner < last; ++corner) {
+                uint32_t next = corner + 1 < last ? corner + 1 : first;
+                uint32_t a = geometry.controlPoints[corner];
+                uint32_t b = geometry.controlPoints[next];
+                if (a == b)
+                    continue;
+                uint64_t key = ((uint64_t)std::min(a, b) << 32) | std::max(a, b);
+                auto inserted = edges.emplace(key, corner);
+                if (inserted.second)
+                    continue;
+
+                uint32_t other = inserted.first->second;
+                if (cornerPolygon[other] == polygon || !isSmooth(corner, other))
+                    continue;
+                uint32_t otherPolygon = cornerPolygon[other];
+                uint32_t otherNext = other + 1 < geometry.polygonOffsets[otherPolygon + 1] ? other + 1 : geometry.polygonOffsets[otherPolygon];
+                // Match up the corners on the same control point, the other polygon may run the edge in either direction
+                if (geometry.controlPoints[other] == a) {
+                    sets.merge(corner, other);
+                    sets.merge(next, otherNext);
+                } else {
+                    sets.merge(corner, otherNext);
+                    sets.merge(next, other);
+                }
+            }
+        }
+
+        // Sum the angle weighted polygon normals per set
+        std::vector<uint32_t> roots(cornerCount);
+        std::vector<Vec3> sums(cornerCount);
+        for (uint32_t corner = 0; corner < (uint32_t)cornerCount; ++corner) {
+            roots[corner] = sets.find(corner);
+            sums[roots[corner]] = add(sums[roots[corner]], scale(polygonNormals[cornerPolygon[corner]], cornerAngles[corner]));
+        }
+
+        std::vector<float> result(cornerCount * 3, 0.0f);
+        TT_FBX::parallelFor(cornerCount, [&](size_t corner) {
+            Vec3 normal = sums[roots[corner]];
+            // Degenerate corners fall back to their own polygon
+            if (!normalize(normal))
+                normal = polygonNormals[cornerPolygon[corner]];
+            result[corner * 3] = normal.x;
+            result[corner * 3 + 1] = normal.y;
+            result[corner * 3 + 2] = normal.z;
+        });
+        return result;
+    }
+}
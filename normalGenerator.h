@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "tangentGenerator.h"
+
+namespace TT_FBX {
+    // Decides which polygons around a vertex are smoothed together. Polygons are only ever smoothed
+    // across an edge they share, and smoothness spreads over chains of smooth edges around a vertex.
+    struct NormalSmoothing {
+        // Smoothing group bit mask per polygon, an edge is smooth when the polygons on either side share a bit. Empty to skip.
+        std::vector<int> polygonGroups;
+        // Per corner, whether the edge from this corner to the next corner of its polygon is smooth. Empty to skip.
+        std::vector<uint8_t> smoothEdges;
+        // Without smoothing groups or edges, an edge is smooth when the polygon normals differ by at most this many degrees.
+        float creaseAngle = 60.0f;
+    };
+
+    // Generate a unit normal for every corner, 3 floats per corner. Each corner gets the sum of the normals of all polygons
+    // it is smoothed with, weighted by the angle of the polygon at that corner. Uses positions, controlPoints and polygonOffsets.
+    std::vector<float> generateNormals(const CornerGeometry& geometry, const NormalSmoothing& smoothing);
+}
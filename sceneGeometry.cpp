@@ -0,0 +1,216 @@
+#include <fbxsdk.h>
+#include <cstring>
+#include <map>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include "fbxLoader.h"
+#include "sceneGeometry.h"
+#include "spillFile.h"
+
+namespace {
+    // Large blobs are split up so a single huge mesh still spreads over all threads.
+    constexpr uint64_t COPY_CHUNK_SIZE = 4 * 1024 * 1024;
+
+    struct Copy {
+        const uint8_t* source = nullptr;
+        uint32_t page = 0;
+        uint64_t destination = 0;
+        uint64_t size = 0;
+    };
+
+    void addCopy(std::vector<Copy>& copies, const uint8_t* source, uint32_t page, uint64_t destination, uint64_t size) {
+        for (uint64_t offset = 0; offset < size; offset += COPY_CHUNK_SIZE)
+            copies.push_back({ source + offset, page, destination + offset, std::min(COPY_CHUNK_SIZE, size - offset) });
+    }
+
+    inline uint64_t alignUp(uint64_t value, uint64_t alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    struct Page {
+        uint64_t vertexSize = 0;
+        uint64_t indexCount = 0;
+    };
+
+    // Make room for a vertex and index range, in a new page when the current one can't address all of it with 32 bit draw parameters.
+    // Returns the page, vertexOffset and firstIndex are where the ranges start in it.
+    uint32_t place(std::vector<Page>& pages, uint64_t alignment, uint32_t stride, uint64_t vertexSize, uint64_t indexCount, uint64_t& vertexOffset, uint64_t& firstIndex) {
+        Page* page = &pages.back();
+        uint64_t offset = alignUp(page->vertexSize, alignment);
+        bool fits = (offset + vertexSize) / stride <= UINT32_MAX && page->indexCount + indexCount <= UINT32_MAX;
+        if (!fits && (page->vertexSize != 0 || page->indexCount != 0)) {
+            pages.emplace_back();
+            page = &pages.back();
+            offset = 0;
+        }
+        vertexOffset = offset;
+        firstIndex = page->indexCount;
+        page->vertexSize = offset + vertexSize;
+        page->indexCount += indexCount;
+        return (uint32_t)(pages.size() - 1);
+    }
+
+    // Gives every distinct material name and vertex layout an id.
+    class SceneTables {
+    public:
+        std::vector<std::string> materialNames;
+        std::vector<const MultiMeshData*> layoutOwners;
+
+        uint32_t materialId(const String& name) {
+            std::string key(name.buffer, name.length);
+            auto inserted = materialIds.emplace(key, (uint32_t)materialNames.size());
+            if (inserted.second)
+                materialNames.push_back(key);
+            return inserted.first->second;
+        }
+
+        uint32_t layoutId(const MultiMeshData& mesh) {
+            std::string key;
+            for (uint32_t i = 0; i < mesh.attributeCount; ++i) {
+                const VertexAttribute& attribute = mesh.attributeLayout[i];
+                key.push_back((char)attribute.semantic);
+                key.push_back((char)attribute.numElements);
+                key.push_back((char)(attribute.elementType == ElementType::Float));
+                key.append((const char*)&attribute.offset, sizeof(attribute.offset));
+            }
+            auto inserted = layoutIds.emplace(key, (uint32_t)layoutOwners.size());
+            if (inserted.second)
+                layoutOwners.push_back(&mesh);
+            return inserted.first->second;
+        }
+
+    private:
+        std::map<std::string, uint32_t> materialIds;
+        std::map<std::string, uint32_t> layoutIds;
+    };
+}
+
+extern "C" {
+    __declspec(dllexport) SceneGeometry* extractSceneGeometry(const FbxImportContext* context, const MeshExtractSettings* settings, uint32_t vertexAlignment) {
+        if (!TT_FBX::checkContext(context))
+            return nullptr;
+
+        MeshExtractSettings defaultSettings;
+        if (!settings)
+            settings = &defaultSettings;
+
+        MeshExtractSettings geometrySettings = *settings;
+        geometrySettings.flags = (MeshExtractFlags)((int)settings->flags & ~((int)MeshExtractFlags::BuildMeshlets | (int)MeshExtractFlags::BuildBvh));
+        geometrySettings.lodCount = 0;
+        geometrySettings.streamMode = VertexStreamMode::Interleaved;
+        geometrySettings.memoryBudget = 0;
+
+        // Extraction talks to the fbx scene, so only the copies into the megabuffers run in parallel
+        const FbxArray<FbxNode*>& meshNodes = context->info->meshNodes;
+        TT_FBX::Arena meshArena;
+        TT_FBX::BufferBudget unlimited(meshArena, 0, nullptr);
+        std::vector<MultiMeshData> meshes(meshNodes.GetCount());
+        for (int i = 0; i < meshNodes.GetCount(); ++i)
+            meshes[i] = TT_FBX::extractMesh(meshNodes[i], context->info->transforms, geometrySettings, meshArena, unlimited);
+
+        // Lay out the megabuffers first, the copies only need to know where everything goes
+        SceneTables tables;
+        std::vector<SceneDraw> draws;
+        std::vector<Copy> vertexCopies;
+        std::vector<Copy> indexCopies;
+        std::vector<Page> pages(1);
+        for (uint32_t m = 0; m < (uint32_t)meshes.size(); ++m) {
+            const MultiMeshData& mesh = meshes[m];
+            if (mesh.attributeCount == 0)
+                continue;
+            uint32_t stride = mesh.attributeLayout[0].stride;
+            uint64_t alignment = std::lcm((uint64_t)stride, (uint64_t)std::max(vertexAlignment, 1u));
+            uint32_t layoutId = tables.layoutId(mesh);
+
+            // A shared vertex buffer is placed once, its draws only differ by their ranges
+            uint32_t sharedPage = 0;
+            uint64_t sharedVertexOffset = 0;
+            uint64_t sharedFirstIndex = 0;
+            if (mesh.sharedVertexDataBlob) {
+                sharedPage = place(pages, alignment, stride, mesh.sharedVertexDataSizeInBytes, mesh.sharedIndexDataSizeInBytes / sizeof(uint32_t), sharedVertexOffset, sharedFirstIndex);
+                addCopy(vertexCopies, mesh.sharedVertexDataBlob, sharedPage, sharedVertexOffset, mesh.sharedVertexDataSizeInBytes);
+                addCopy(indexCopies, mesh.sharedIndexDataBlob, sharedPage, sharedFirstIndex * sizeof(uint32_t), mesh.sharedIndexDataSizeInBytes);
+            }
+
+            for (uint32_t s = 0; s < mesh.meshCount; ++s) {
+                const MeshData& subMesh = mesh.meshes[s];
+                SceneDraw draw;
+                draw.meshIndex = m;
+                draw.subMeshIndex = s;
+                draw.materialId = tables.materialId(mesh.materialNames[subMesh.materialId]);
+                draw.layoutId = layoutId;
+                draw.stride = stride;
+                draw.indexCount = subMesh.indexCount;
+                draw.bounds = subMesh.bounds;
+
+                // place() keeps every range of a page within 32 bits, so these casts can't truncate
+                if (mesh.sharedVertexDataBlob) {
+                    draw.page = sharedPage;
+                    draw.firstIndex = (uint32_t)(sharedFirstIndex + subMesh.firstIndex);
+                    draw.baseVertex = (uint32_t)(sharedVertexOffset / stride + subMesh.baseVertex);
+                    draw.vertexCount = mesh.sharedVertexCount - subMesh.baseVertex;
+                } else {
+                    uint64_t vertexOffset = 0;
+                    uint64_t firstIndex = 0;
+                    draw.page = place(pages, alignment, stride, subMesh.vertexDataSizeInBytes, subMesh.indexDataSizeInBytes / sizeof(uint32_t), vertexOffset, firstIndex);
+                    draw.firstIndex = (uint32_t)firstIndex;
+                    draw.baseVertex = (uint32_t)(vertexOffset / stride);
+                    draw.vertexCount = subMesh.vertexCount;
+                    addCopy(vertexCopies, subMesh.vertexDataBlob, draw.page, vertexOffset, subMesh.vertexDataSizeInBytes);
+                    addCopy(indexCopies, subMesh.indexDataBlob, draw.page, firstIndex * sizeof(uint32_t), subMesh.indexDataSizeInBytes);
+                }
+                draw.vertexByteOffset = (uint64_t)draw.baseVertex * stride;
+                draws.push_back(draw);
+            }
+        }
+
+        // Alignment padding stays zero
+        std::vector<std::vector<uint8_t>> vertexData(pages.size());
+        std::vector<std::vector<uint32_t>> indexData(pages.size());
+        for (size_t i = 0; i < pages.size(); ++i) {
+            vertexData[i].resize(pages[i].vertexSize);
+            indexData[i].resize(pages[i].indexCount);
+        }
+        TT_FBX::parallelFor(vertexCopies.size() + indexCopies.size(), [&](size_t i) {
+            bool isVertexCopy = i < vertexCopies.size();
+            const Copy& copy = isVertexCopy ? vertexCopies[i] : indexCopies[i - vertexCopies.size()];
+            uint8_t* target = isVertexCopy ? vertexData[copy.page].data() : (uint8_t*)indexData[copy.page].data();
+            memcpy(target + copy.destination, copy.source, copy.size);
+        });
+
+        // The result is the first allocation so freeSceneGeometry can find the arena from it
+        TT_FBX::Arena arena;
+        SceneGeometry* result = arena.allocate<SceneGeometry>(1);
+        TT_FBX::BufferBudget budget(arena, settings->memoryBudget, settings->spillDirectory);
+        result->materialNameCount = (uint32_t)tables.materialNames.size();
+        result->materialNames = arena.makeStringList(tables.materialNames);
+        result->layoutCount = (uint32_t)tables.layoutOwners.size();
+        result->layouts = arena.allocate<SceneLayout>(tables.layoutOwners.size());
+        for (size_t i = 0; i < tables.layoutOwners.size(); ++i) {
+            const MultiMeshData& owner = *tables.layoutOwners[i];
+            result->layouts[i].attributeCount = owner.attributeCount;
+            result->layouts[i].attributeLayout = arena.flattenList(std::vector<VertexAttribute>(owner.attributeLayout, owner.attributeLayout + owner.attributeCount));
+        }
+        result->drawCount = (uint32_t)draws.size();
+        result->draws = arena.flattenList(draws);
+        result->pageCount = (uint32_t)pages.size();
+        result->pages = arena.allocate<SceneGeometryPage>(pages.size());
+        for (size_t i = 0; i < pages.size(); ++i) {
+            SceneGeometryPage& page = result->pages[i];
+            page.vertexDataSizeInBytes = vertexData[i].size();
+            page.vertexDataBlob = budget.adopt(std::move(vertexData[i]));
+            page.indexDataSizeInBytes = indexData[i].size() * sizeof(uint32_t);
+            page.indexDataBlob = (uint8_t*)budget.adopt(std::move(indexData[i]));
+        }
+
+        arena.detach();
+        return result;
+    }
+
+    __declspec(dllexport) void freeSceneGeometry(const SceneGeometry* geometry) {
+        // Everything was allocated in one arena
+        TT_FBX::Arena::release(geometry);
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "meshParser.h"
+
+extern "C" {
+    // A vertex layout used by one or more draws, see SceneDraw::layoutId.
+    struct SceneLayout {
+        uint32_t attributeCount = 0;
+        VertexAttribute* attributeLayout = nullptr;
+    };
+
+    // One submesh of one mesh in the megabuffers, DrawIndexed style: index i of the draw
+    // reads vertex baseVertex + indexDataBlob[firstIndex + i] of its page.
+    struct SceneDraw {
+        // Index in extractMeshes order, which is what Node::meshIndex refers to, and the submesh within that mesh.
+        uint32_t meshIndex = 0;
+        uint32_t subMeshIndex = 0;
+        // An index into SceneGeometry::materialNames.
+        uint32_t materialId = 0;
+        // An index into SceneGeometry::layouts.
+        uint32_t layoutId = 0;
+        uint32_t stride = 0;
+
+        // An index into SceneGeometry::pages.
+        uint32_t page = 0;
+        uint32_t firstIndex = 0;
+        uint32_t indexCount = 0;
+        uint32_t baseVertex = 0;
+        // Vertices from baseVertex on that the indices may reference.
+        uint32_t vertexCount = 0;
+        // baseVertex * stride, for renderers that fetch vertices by byte address.
+        uint64_t vertexByteOffset = 0;
+
+        Bounds bounds;
+    };
+
+    // A vertex and an index buffer. A page ends before a draw's baseVertex or index range would pass 32 bits.
+    struct SceneGeometryPage {
+        // Vertices of different layouts are mixed, every mesh starts at a multiple of both its stride and the requested alignment.
+        uint64_t vertexDataSizeInBytes = 0;
+        uint8_t* vertexDataBlob = nullptr;
+        // 32 bit indices, relative to the baseVertex of their draw.
+        uint64_t indexDataSizeInBytes = 0;
+        uint8_t* indexDataBlob = nullptr;
+    };
+
+    // All geometry of the scene in one vertex and one index buffer, or a few once the scene outgrows 32 bit draw parameters.
+    struct SceneGeometry {
+        uint32_t materialNameCount = 0;
+        String* materialNames = nullptr;
+
+        uint32_t layoutCount = 0;
+        SceneLayout* layouts = nullptr;
+
+        uint32_t drawCount = 0;
+        SceneDraw* draws = nullptr;
+
+        uint32_t pageCount = 0;
+        SceneGeometryPage* pages = nullptr;
+    };
+
+    // Extract every mesh like extractMeshes and pack them into megabuffers, the copies run in parallel.
+    // Vertices are always interleaved and there are no meshlets, BVHs or LODs, shared vertex buffers stay shared between their draws.
+    // vertexAlignment is in bytes, 0 or 1 only aligns meshes to their stride.
+    __declspec(dllexport) SceneGeometry* extractSceneGeometry(const struct FbxImportContext* context, const MeshExtractSettings* settings, uint32_t vertexAlignment);
+    __declspec(dllexport) void freeSceneGeometry(const SceneGeometry* geometry);
+}
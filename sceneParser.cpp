@@ -23,9 +23,10 @@ extern "C" {
             return nullptr;
         }
 
-        std::vector<Node> scene;
+        // The result array is the first allocation so freeNodes can find the arena from it
+        TT_FBX::Arena arena;
+        Node* scene = arena.allocate<Node>(context->info->transforms.GetCount());
 
-        int meshCounter = 0;
         for (int i = 0; i < context->info->transforms.GetCount(); ++i) {
             FbxNode* node = context->info->transforms[i];
 
@@ -43,27 +44,36 @@ extern "C" {
 
             // Get the node name as a buffer we own
             FbxString name = node->GetNameOnly();
-            char* buffer = new char[name.Size()];
-            memcpy(buffer, name.Buffer(), name.Size());
+            String nameString = arena.makeString(name.Buffer(), name.Size());
 
-            // Track if this transform has a mesh, and if so, at what index that would be in the flattened mesh array
-            int meshIndex = -1;
-            if (node->GetNodeAttribute() && node->GetNodeAttribute()->GetAttributeType() == FbxNodeAttribute::eMesh) {
-                meshIndex = meshCounter;
-                meshCounter++;
-            }
+            // Index in the flattened mesh array, instances share one
+            int meshIndex = context->info->transformMeshIds[i];
 
-            scene.push_back({ { (unsigned int)name.Size(), buffer }, t[0], t[1], t[2], r[0], r[1], r[2], s[0], s[1], s[2], rotateOrderInts[(int)rotateOrder], context->info->transformParentIds[i], meshIndex });
+            scene[i] = { nameString, t[0], t[1], t[2], r[0], r[1], r[2], s[0], s[1], s[2], rotateOrderInts[(int)rotateOrder], context->info->transformParentIds[i], meshIndex };
         }
 
         // Output the resulting scene
-        *outCount = (uint32_t)scene.size();
-        return TT_FBX::flattenList(scene);
+        arena.detach();
+        *outCount = (uint32_t)context->info->transforms.GetCount();
+        return scene;
     }
 
-    __declspec(dllexport) void freeNodes(const Node* nodes, uint32_t nodeCount) {
-        for (unsigned int i = 0; i < nodeCount; ++i)
-            delete[] nodes[i].name.buffer;
-        delete[] nodes;
+    __declspec(dllexport) void freeNodes(const Node* nodes, uint32_t /*nodeCount*/) {
+        // Everything was allocated in one arena
+        TT_FBX::Arena::release(nodes);
+    }
+
+    __declspec(dllexport) int findNode(const FbxImportContext* context, const char* name) {
+        if (!TT_FBX::checkContext(context) || !name)
+            return -1;
+
+        // Names are looked up often by editors, so they are indexed once and kept in the context
+        TT_FBX::SceneInfo& info = *context->info;
+        if (info.nodeIds.empty()) {
+            for (int i = 0; i < info.transforms.GetCount(); ++i)
+                info.nodeIds.emplace(info.transforms[i]->GetNameOnly().Buffer(), i);
+        }
+        auto it = info.nodeIds.find(name);
+        return it == info.nodeIds.end() ? -1 : it->second;
     }
 }
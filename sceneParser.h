@@ -8,7 +8,7 @@ extern "C" {
     // into this struct and added to an output array.
     // The parentIndex will point to the parent node in that array.
     // Similarly when loading meshes we get a MutliMeshData array,
-    // and the meshIndex points to that.
+    // and the meshIndex points to that. Nodes that instance the same mesh share a meshIndex.
     // -1 means no parent / no mesh.
     struct Node {
         String name;
@@ -28,4 +28,6 @@ extern "C" {
 
     __declspec(dllexport) Node* extractNodes(const struct FbxImportContext* context, uint32_t* outCount);
     __declspec(dllexport) void freeNodes(const Node* nodes, uint32_t nodeCount);
+    // Index of the first node with this name in extractNodes order, or -1.
+    __declspec(dllexport) int findNode(const struct FbxImportContext* context, const char* name);
 }
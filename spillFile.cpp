@@ -0,0 +1,128 @@
+// Before anything else can pull in windows.h without NOMINMAX
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include <fbxsdk.h>
+#include <algorithm>
+#include <string>
+
+#include "spillFile.h"
+
+namespace {
+    // Views must start at a multiple of the allocation granularity on Windows, which is also a multiple of every page size.
+    constexpr uint64_t VIEW_ALIGNMENT = 64 * 1024;
+    // Writes are split up, a single call can't write more than 4 GiB on Windows.
+    constexpr size_t WRITE_CHUNK = 1 << 30;
+}
+
+namespace TT_FBX {
+#ifdef _WIN32
+    SpillFile::SpillFile(const char* directory) {
+        char temp[MAX_PATH];
+        if (!directory) {
+            if (!GetTempPathA(MAX_PATH, temp))
+                return;
+            directory = temp;
+        }
+        char path[MAX_PATH];
+        if (!GetTempFileNameA(directory, "fbx", 0, path))
+            return;
+        HANDLE file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+        if (file != INVALID_HANDLE_VALUE)
+            handle = file;
+    }
+
+    SpillFile::~SpillFile() {
+        for (const View& view : views)
+            UnmapViewOfFile(view.address);
+        if (handle)
+            CloseHandle(handle);
+    }
+
+    uint8_t* SpillFile::spill(const void* data, size_t size) {
+        if (!handle || size == 0)
+            return nullptr;
+
+        uint64_t offset = (fileSize + VIEW_ALIGNMENT - 1) / VIEW_ALIGNMENT * VIEW_ALIGNMENT;
+        LARGE_INTEGER position;
+        position.QuadPart = (LONGLONG)offset;
+        if (!SetFilePointerEx(handle, position, nullptr, FILE_BEGIN))
+            return nullptr;
+        for (size_t written = 0; written < size;) {
+            DWORD count = 0;
+            if (!WriteFile(handle, (const uint8_t*)data + written, (DWORD)std::min(WRITE_CHUNK, size - written), &count, nullptr) || count == 0)
+                return nullptr;
+            written += count;
+        }
+        fileSize = offset + size;
+
+        // The view keeps the mapping alive, so its handle can be closed right away
+        HANDLE mapping = CreateFileMappingA(handle, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+        if (!mapping)
+            return nullptr;
+        void* address = MapViewOfFile(mapping, FILE_MAP_COPY, (DWORD)(offset >> 32), (DWORD)offset, size);
+        CloseHandle(mapping);
+        if (!address)
+            return nullptr;
+        views.push_back({ address, size });
+        return (uint8_t*)address;
+    }
+#else
+    SpillFile::SpillFile(const char* directory) {
+        if (!directory)
+            directory = getenv("TMPDIR");
+        std::string path = std::string(directory ? directory : "/tmp") + "/fbxXXXXXX";
+        handle = mkstemp(&path[0]);
+        // Unlinked right away, the file is gone as soon as the handle is closed
+        if (handle != -1)
+            unlink(path.c_str());
+    }
+
+    SpillFile::~SpillFile() {
+        for (const View& view : views)
+            munmap(view.address, view.size);
+        if (handle != -1)
+            close(handle);
+    }
+
+    uint8_t* SpillFile::spill(const void* data, size_t size) {
+        if (handle == -1 || size == 0)
+            return nullptr;
+
+        uint64_t offset = (fileSize + VIEW_ALIGNMENT - 1) / VIEW_ALIGNMENT * VIEW_ALIGNMENT;
+        for (size_t written = 0; written < size;) {
+            ssize_t count = pwrite(handle, (const uint8_t*)data + written, std::min(WRITE_CHUNK, size - written), (off_t)(offset + written));
+            if (count <= 0)
+                return nullptr;
+            written += (size_t)count;
+        }
+        fileSize = offset + size;
+
+        void* address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, handle, (off_t)offset);
+        if (address == MAP_FAILED)
+            return nullptr;
+        views.push_back({ address, size });
+        return (uint8_t*)address;
+    }
+#endif
+
+    void* BufferBudget::spill(const void* data, size_t size) {
+        if (size == 0 || budget == 0 || used + size <= budget) {
+            used += size;
+            return nullptr;
+        }
+
+        // Created on first use, most extractions never get here
+        if (!file)
+            file = arena.emplace<SpillFile>(directory);
+        return file->spill(data, size);
+    }
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "common.h"
+
+namespace TT_FBX {
+    // Temporary file that buffers are written to and mapped back from, so the OS can page them out instead of running out of memory.
+    // Views are copy-on-write, writing to them never touches the file. The file is deleted when this is destroyed, or by the OS on a crash.
+    class SpillFile {
+    public:
+        // directory may be nullptr for the system temp directory.
+        explicit SpillFile(const char* directory);
+        SpillFile(const SpillFile&) = delete;
+        SpillFile& operator=(const SpillFile&) = delete;
+        ~SpillFile();
+
+        // Append the bytes and map them, returns nullptr if the disk is full or mapping failed.
+        uint8_t* spill(const void* data, size_t size);
+
+    private:
+        struct View {
+            void* address = nullptr;
+            size_t size = 0;
+        };
+
+#ifdef _WIN32
+        void* handle = nullptr;
+#else
+        int handle = -1;
+#endif
+        uint64_t fileSize = 0;
+        std::vector<View> views;
+    };
+
+    // Hands buffers over to an arena until the budget is used up, then moves them into a SpillFile owned by that same arena.
+    // The caller can't tell the difference, both stay valid until the arena is released.
+    class BufferBudget {
+    public:
+        // A budget of 0 keeps everything in memory.
+        BufferBudget(Arena& arena, uint64_t budget, const char* directory) : arena(arena), budget(budget), directory(directory) {}
+
+        // For a budget shared by several calls, the limit and directory of the current one. What is in memory already stays counted.
+        void setLimit(uint64_t budget, const char* directory) {
+            this->budget = budget;
+            this->directory = directory;
+        }
+
+        // Start counting from zero, after the arena was cleared along with everything it adopted.
+        void clear() {
+            used = 0;
+            file = nullptr;
+        }
+
+        template<typename T>
+        T* adopt(std::vector<T>&& list) {
+            if (T* spilled = (T*)spill(list.data(), list.size() * sizeof(T))) {
+                list = {};
+                return spilled;
+            }
+            return arena.adopt(std::move(list));
+        }
+
+    private:
+        Arena& arena;
+        uint64_t budget = 0;
+        uint64_t used = 0;
+        const char* directory = nullptr;
+        SpillFile* file = nullptr;
+
+        // Returns nullptr when the buffer stays in memory, because it fits the budget or because spilling failed.
+        void* spill(const void* data, size_t size);
+    };
+}
@@ -0,0 +1,290 @@
+#include <fbxsdk.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "fbxLoader.h"
+#include "boundsBuilder.h"
+#include "spillFile.h"
+#include "staticBatcher.h"
+
+namespace {
+    // The world transform of a node as floats, in the row vector convention of FbxAMatrix: v' = v * linear + translation.
+    struct BakeTransform {
+        float linear[3][3] = {};
+        float translation[3] = {};
+        // Inverse transpose of linear, keeps normals perpendicular under non uniform scale.
+        float normal[3][3] = {};
+        // Mirroring flips the triangle winding and the bitangent sign.
+        bool mirrored = false;
+    };
+
+    BakeTransform getBakeTransform(FbxNode* node) {
+        // The geometric transform offsets only the mesh, not the children
+        FbxAMatrix geometry(node->GetGeometricTranslation(FbxNode::eSourcePivot), node->GetGeometricRotation(FbxNode::eSourcePivot), node->GetGeometricScaling(FbxNode::eSourcePivot));
+        FbxAMatrix world = node->EvaluateGlobalTransform() * geometry;
+        FbxAMatrix inverse = world.Inverse();
+
+        BakeTransform result;
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 3; ++j) {
+                result.linear[i][j] = (float)world.Get(i, j);
+                result.normal[i][j] = (float)inverse.Get(j, i);
+            }
+            result.translation[i] = (float)world.Get(3, i);
+        }
+        result.mirrored = world.Determinant() < 0.0;
+        return result;
+    }
+
+    inline void transform(float* v, const float m[3][3], const float* translation) {
+        float result[3];
+        for (int j = 0; j < 3; ++j)
+            result[j] = v[0] * m[0][j] + v[1] * m[1][j] + v[2] * m[2][j] + (translation ? translation[j] : 0.0f);
+        memcpy(v, result, sizeof(result));
+    }
+
+    inline void normalize(float* v) {
+        float length = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+        if (length <= 1e-20f)
+            return;
+        for (int i = 0; i < 3; ++i)
+            v[i] /= length;
+    }
+
+    // Move interleaved vertices into world space, attributes that are not positions or directions are copied as is.
+    void bakeVertices(uint8_t* vertices, size_t vertexCount, const MultiMeshData& mesh, const BakeTransform& bake) {
+        for (uint32_t a = 0; a < mesh.attributeCount; ++a) {
+            const VertexAttribute& attribute = mesh.attributeLayout[a];
+            int semantic = (int)attribute.semantic;
+            bool isPosition = attribute.semantic == Semantic::Position;
+            bool isNormal = semantic >= (int)Semantic::Normal && semantic < (int)Semantic::Tangent;
+            bool isDirection = semantic >= (int)Semantic::Tangent && semantic < (int)Semantic::UV;
+            if (!isPosition && !isNormal && !isDirection)
+                continue;
+
+            for (size_t v = 0; v < vertexCount; ++v) {
+                float* value = (float*)(vertices + v * attribute.stride + attribute.offset);
+                if (isPosition) {
+                    transform(value, bake.linear, bake.translation);
+                } else if (isNormal) {
+                    transform(value, bake.normal, nullptr);
+                    normalize(value);
+                } else {
+                    transform(value, bake.linear, nullptr);
+                    normalize(value);
+                    // Generated tangents carry the bitangent sign in w
+                    if (attribute.numElements == NumElements::Vec4 && bake.mirrored)
+                        value[3] = -value[3];
+                }
+            }
+        }
+    }
+
+    bool isTransformAnimated(FbxNode* node, FbxScene* scene) {
+        for (int i = 0; i < scene->GetSrcObjectCount<FbxAnimStack>(); ++i) {
+            FbxAnimStack* stack = scene->GetSrcObject<FbxAnimStack>(i);
+            for (int j = 0; j < stack->GetMemberCount<FbxAnimLayer>(); ++j) {
+                FbxAnimLayer* layer = stack->GetMember<FbxAnimLayer>(j);
+                if (node->LclTranslation.IsAnimated(layer) || node->LclRotation.IsAnimated(layer) || node->LclScaling.IsAnimated(layer))
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    // Per transform, whether it ever moves. Transforms are stored breadth first, so parents are always resolved first.
+    std::vector<bool> getAnimatedTransforms(const TT_FBX::SceneInfo& info, FbxScene* scene) {
+        std::vector<bool> animated(info.transforms.GetCount(), false);
+        for (int i = 0; i < info.transforms.GetCount(); ++i) {
+            int parent = info.transformParentIds[i];
+            animated[i] = (parent != -1 && animated[parent]) || isTransformAnimated(info.transforms[i], scene);
+        }
+        return animated;
+    }
+
+    struct BatchBuilder {
+        uint32_t materialId = 0;
+        std::vector<VertexAttribute> layout;
+        uint32_t stride = 0;
+        std::vector<uint8_t> vertexData;
+        std::vector<uint32_t> indexData;
+        std::vector<BatchRange> ranges;
+    };
+
+    // Batches merge submeshes with the same material and layout, the layout is compared by what the vertex holds.
+    std::string layoutKey(const MultiMeshData& mesh) {
+        std::string key;
+        for (uint32_t i = 0; i < mesh.attributeCount; ++i) {
+            const VertexAttribute& attribute = mesh.attributeLayout[i];
+            key.push_back((char)attribute.semantic);
+            key.push_back((char)attribute.numElements);
+            key.push_back((char)(attribute.elementType == ElementType::Float));
+        }
+        return key;
+    }
+
+    class Batcher {
+    public:
+        std::vector<std::string> materialNames;
+        std::vector<BatchBuilder> batches;
+
+        void add(int nodeIndex, const MultiMeshData& mesh, const BakeTransform& bake) {
+            std::string layout = layoutKey(mesh);
+            uint32_t stride = mesh.attributeCount ? mesh.attributeLayout[0].stride : 0;
+            for (uint32_t i = 0; i < mesh.meshCount; ++i) {
+                const MeshData& subMesh = mesh.meshes[i];
+                if (subMesh.indexCount == 0 || subMesh.vertexCount == 0)
+                    continue;
+                BatchBuilder& batch = getBatch(materialId(mesh.materialNames[subMesh.materialId]), layout, mesh, subMesh.vertexCount, subMesh.indexCount);
+
+                BatchRange range;
+                range.nodeIndex = nodeIndex;
+                range.firstIndex = (uint32_t)batch.indexData.size();
+                range.indexCount = subMesh.indexCount;
+                range.firstVertex = (uint32_t)(batch.vertexData.size() / stride);
+                range.vertexCount = subMesh.vertexCount;
+
+                batch.vertexData.insert(batch.vertexData.end(), subMesh.vertexDataBlob, subMesh.vertexDataBlob + subMesh.vertexDataSizeInBytes);
+                uint8_t* vertices = batch.vertexData.data() + (size_t)range.firstVertex * stride;
+                bakeVertices(vertices, range.vertexCount, mesh, bake);
+                range.bounds = TT_FBX::computeBounds({ { vertices, stride, range.vertexCount } });
+
+                const uint32_t* indices = (const uint32_t*)subMesh.indexDataBlob;
+                for (uint32_t j = 0; j + 2 < subMesh.indexCount; j += 3) {
+                    batch.indexData.push_back(indices[j] + range.firstVertex);
+                    // Mirrored nodes would render inside out otherwise
+                    batch.indexData.push_back(indices[j + (bake.mirrored ? 2 : 1)] + range.firstVertex);
+                    batch.indexData.push_back(indices[j + (bake.mirrored ? 1 : 2)] + range.firstVertex);
+                }
+                batch.ranges.push_back(range);
+            }
+        }
+
+    private:
+        std::map<std::string, uint32_t> materialIds;
+        // Batch key to the batch that is being filled, full batches are left behind in batches.
+        std::map<std::pair<uint32_t, std::string>, size_t> openBatches;
+
+        uint32_t materialId(const String& name) {
+            std::string key(name.buffer, name.length);
+            auto inserted = materialIds.emplace(key, (uint32_t)materialNames.size());
+            if (inserted.second)
+                materialNames.push_back(key);
+            return inserted.first->second;
+        }
+
+        // A batch is full once its vertices or indices would no longer be addressable with 32 bits.
+        BatchBuilder& getBatch(uint32_t material, const std::string& layout, const MultiMeshData& mesh, uint32_t vertexCount, uint32_t indexCount) {
+            auto it = openBatches.find({ material, layout });
+            if (it != openBatches.end()) {
+                BatchBuilder& batch = batches[it->second];
+                if (batch.vertexData.size() / batch.stride + vertexCount <= UINT32_MAX && batch.indexData.size() + indexCount <= UINT32_MAX)
+                    return batch;
+            }
+
+            BatchBuilder batch;
+            batch.materialId = material;
+            batch.layout.assign(mesh.attributeLayout, mesh.attributeLayout + mesh.attributeCount);
+            batch.stride = mesh.attributeLayout[0].stride;
+            openBatches[{ material, layout }] = batches.size();
+            batches.push_back(std::move(batch));
+            return batches.back();
+        }
+    };
+}
+
+extern "C" {
+    __declspec(dllexport) StaticBatches* buildStaticBatches(const FbxImportContext* context, const MeshExtractSettings* settings) {
+        if (!TT_FBX::checkContext(context))
+            return nullptr;
+
+        MeshExtractSettings defaultSettings;
+        if (!settings)
+            settings = &defaultSettings;
+
+        // Baking needs whole interleaved vertices per submesh
+        MeshExtractSettings batchSettings = *settings;
+        batchSettings.flags = (MeshExtractFlags)((int)settings->flags & ~((int)MeshExtractFlags::SharedVertexBuffer | (int)MeshExtractFlags::BuildMeshlets | (int)MeshExtractFlags::BuildBvh));
+        batchSettings.lodCount = 0;
+        batchSettings.streamMode = VertexStreamMode::Interleaved;
+        batchSettings.memoryBudget = 0;
+
+        // Group the static nodes by mesh, so every mesh is extracted once and freed before the next one
+        const TT_FBX::SceneInfo& info = *context->info;
+        std::vector<bool> animated = getAnimatedTransforms(info, context->scene);
+        std::map<int, std::vector<int>> nodesByMesh;
+        for (int i = 0; i < info.transforms.GetCount(); ++i) {
+            int meshId = info.transformMeshIds[i];
+            if (meshId == -1 || animated[i])
+                continue;
+            const FbxMesh* mesh = (const FbxMesh*)info.meshNodes[meshId]->GetNodeAttribute();
+            if (mesh->GetDeformerCount() > 0)
+                continue;
+            nodesByMesh[meshId].push_back(i);
+        }
+
+        Batcher batcher;
+        for (const auto& entry : nodesByMesh) {
+            TT_FBX::Arena meshArena;
+            TT_FBX::BufferBudget unlimited(meshArena, 0, nullptr);
+            MultiMeshData mesh = TT_FBX::extractMesh(info.meshNodes[entry.first], info.transforms, batchSettings, meshArena, unlimited);
+            if (mesh.attributeCount == 0)
+                continue;
+            for (int node : entry.second)
+                batcher.add(node, mesh, getBakeTransform(info.transforms[node]));
+        }
+
+        // Materials in name order, batches by material so consecutive draws share state
+        std::vector<uint32_t> materialOrder(batcher.materialNames.size());
+        for (uint32_t i = 0; i < (uint32_t)materialOrder.size(); ++i)
+            materialOrder[i] = i;
+        std::sort(materialOrder.begin(), materialOrder.end(), [&](uint32_t a, uint32_t b) { return batcher.materialNames[a] < batcher.materialNames[b]; });
+        std::vector<uint32_t> materialRemap(materialOrder.size());
+        std::vector<std::string> materialNames;
+        for (uint32_t i = 0; i < (uint32_t)materialOrder.size(); ++i) {
+            materialRemap[materialOrder[i]] = i;
+            materialNames.push_back(batcher.materialNames[materialOrder[i]]);
+        }
+        std::vector<BatchBuilder>& builders = batcher.batches;
+        for (BatchBuilder& batch : builders)
+            batch.materialId = materialRemap[batch.materialId];
+        std::stable_sort(builders.begin(), builders.end(), [](const BatchBuilder& a, const BatchBuilder& b) { return a.materialId < b.materialId; });
+
+        // The result is the first allocation so freeStaticBatches can find the arena from it
+        TT_FBX::Arena arena;
+        StaticBatches* result = arena.allocate<StaticBatches>(1);
+        TT_FBX::BufferBudget budget(arena, settings->memoryBudget, settings->spillDirectory);
+        result->materialNameCount = (uint32_t)materialNames.size();
+        result->materialNames = arena.makeStringList(materialNames);
+        result->batchCount = (uint32_t)builders.size();
+        result->batches = arena.allocate<StaticBatch>(builders.size());
+        for (size_t i = 0; i < builders.size(); ++i) {
+            BatchBuilder& builder = builders[i];
+            StaticBatch& batch = result->batches[i];
+            batch.materialId = builder.materialId;
+            batch.attributeCount = (uint32_t)builder.layout.size();
+            batch.attributeLayout = arena.flattenList(builder.layout);
+            batch.vertexCount = (uint32_t)(builder.vertexData.size() / builder.stride);
+            batch.bounds = TT_FBX::computeBounds({ { builder.vertexData.data(), builder.stride, batch.vertexCount } });
+            batch.vertexDataSizeInBytes = builder.vertexData.size();
+            batch.vertexDataBlob = budget.adopt(std::move(builder.vertexData));
+            batch.indexCount = (uint32_t)builder.indexData.size();
+            batch.indexDataSizeInBytes = builder.indexData.size() * sizeof(uint32_t);
+            batch.indexDataBlob = (uint8_t*)budget.adopt(std::move(builder.indexData));
+            batch.rangeCount = (uint32_t)builder.ranges.size();
+            batch.ranges = arena.flattenList(builder.ranges);
+        }
+
+        arena.detach();
+        return result;
+    }
+
+    __declspec(dllexport) void freeStaticBatches(const StaticBatches* batches) {
+        // Everything was allocated in one arena
+        TT_FBX::Arena::release(batches);
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "meshParser.h"
+
+extern "C" {
+    // The part of a StaticBatch that one node contributed, one per submesh of its mesh.
+    struct BatchRange {
+        // Index in extractNodes order.
+        int nodeIndex = -1;
+        uint32_t firstIndex = 0;
+        uint32_t indexCount = 0;
+        uint32_t firstVertex = 0;
+        uint32_t vertexCount = 0;
+        // World space.
+        Bounds bounds;
+    };
+
+    // Static geometry of one material and vertex layout, baked into world space. The vertex data is interleaved
+    // and the indices address the whole vertex buffer, so a batch draws with a single call.
+    struct StaticBatch {
+        // An index into StaticBatches::materialNames.
+        uint32_t materialId = 0;
+
+        uint32_t attributeCount = 0;
+        VertexAttribute* attributeLayout = nullptr;
+
+        uint32_t vertexCount = 0;
+        uint64_t vertexDataSizeInBytes = 0;
+        uint8_t* vertexDataBlob = nullptr;
+        uint32_t indexCount = 0;
+        uint64_t indexDataSizeInBytes = 0;
+        uint8_t* indexDataBlob = nullptr;
+
+        uint32_t rangeCount = 0;
+        BatchRange* ranges = nullptr;
+
+        // World space bounds of all ranges.
+        Bounds bounds;
+    };
+
+    struct StaticBatches {
+        uint32_t materialNameCount = 0;
+        String* materialNames = nullptr;
+
+        // Sorted by material, so drawing them in order changes material as little as possible.
+        uint32_t batchCount = 0;
+        StaticBatch* batches = nullptr;
+    };
+
+    // Bake the meshes of all static nodes into world space and merge them per material, this is what ScenePatchFlags::CollapseMeshes describes.
+    // Nodes are static unless their mesh is skinned or has blend shapes, or an animation stack moves them or one of their parents.
+    // Only the nodes listed in the ranges were batched, the others still need their own draws.
+    // The settings apply to every mesh before merging, except that vertices are always interleaved and per submesh,
+    // and there are no meshlets, BVHs or LODs. A batch is split in two before its vertex count would overflow 32 bit indices.
+    __declspec(dllexport) StaticBatches* buildStaticBatches(const struct FbxImportContext* context, const MeshExtractSettings* settings);
+    __declspec(dllexport) void freeStaticBatches(const StaticBatches* batches);
+}
@@ -0,0 +1,597 @@
+#include <fbxsdk.h>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <string_view>
+#include <unordered_map>
+
+#include "common.h"
+#include "tangentGenerator.h"
+
+// A port of the reference MikkTSpace implementation (mikktspace.c by Morten S. Mikkelsen) with its default 180 degree
+// angular threshold. The steps and the order dependent choices follow the reference so baked normal maps match,
+// only the per triangle setup and the per group evaluation run in parallel.
+namespace {
+    constexpr int MARK_DEGENERATE = 1;
+    // A quad of which one triangle is degenerate, the good triangle supplies the corner the other one lacks.
+    constexpr int QUAD_ONE_DEGENERATE_TRIANGLE = 2;
+    // Without a usable uv gradient the triangle joins any group, but adds nothing to it.
+    constexpr int GROUP_WITH_ANY = 4;
+    constexpr int ORIENT_PRESERVING = 8;
+    // Groups evaluated per parallel task, so the scratch buffers are reused.
+    constexpr size_t GROUPS_PER_TASK = 1024;
+
+    struct Vec3 {
+        float x = 0.0f;
+        float y = 0.0f;
+        float z = 0.0f;
+    };
+
+    inline Vec3 add(const Vec3& a, const Vec3& b) { return { a.x + b.x, a.y + b.y, a.z + b.z }; }
+    inline Vec3 sub(const Vec3& a, const Vec3& b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+    inline Vec3 scale(float s, const Vec3& a) { return { s * a.x, s * a.y, s * a.z }; }
+    inline float dot(const Vec3& a, const Vec3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+    inline float lengthSquared(const Vec3& a) { return a.x * a.x + a.y * a.y + a.z * a.z; }
+    inline float length(const Vec3& a) { return sqrtf(lengthSquared(a)); }
+    inline bool equal(const Vec3& a, const Vec3& b) { return a.x == b.x && a.y == b.y && a.z == b.z; }
+    inline bool notZero(float f) { return fabsf(f) > FLT_MIN; }
+    inline bool notZero(const Vec3& a) { return notZero(a.x) || notZero(a.y) || notZero(a.z); }
+    inline Vec3 normalize(const Vec3& a) { return scale(1.0f / length(a), a); }
+
+    // Remove the component along the normal and normalize what is left, if anything is.
+    inline Vec3 projectNormalized(const Vec3& v, const Vec3& normal) {
+        Vec3 projected = sub(v, scale(dot(normal, v), normal));
+        return notZero(projected) ? normalize(projected) : projected;
+    }
+
+    struct Triangle {
+        // Triangle across the edge from corner i to corner i + 1, or -1.
+        int neighbors[3] = { -1, -1, -1 };
+        // Group of each corner, or -1.
+        int groups[3] = { -1, -1, -1 };
+        Vec3 os;
+        Vec3 ot;
+        float magS = 0.0f;
+        float magT = 0.0f;
+        uint32_t face = 0;
+        int flags = 0;
+        // Face vertex of each corner, 0 to 3.
+        uint8_t vertices[3] = {};
+    };
+
+    // Triangles around one welded vertex that are connected across edges and agree on their orientation.
+    struct Group {
+        uint32_t first = 0;
+        uint32_t count = 0;
+        uint32_t vertex = 0;
+        bool orientPreserving = false;
+    };
+
+    struct Space {
+        Vec3 os = { 1.0f, 0.0f, 0.0f };
+        float magS = 1.0f;
+        Vec3 ot = { 0.0f, 1.0f, 0.0f };
+        float magT = 1.0f;
+        int counter = 0;
+        bool orientPreserving = false;
+    };
+
+    // An edge with its welded vertices in increasing order.
+    struct Edge {
+        uint32_t i0 = 0;
+        uint32_t i1 = 0;
+        uint32_t triangle = 0;
+    };
+
+    // The two tangent spaces of a quad vertex that both its triangles use.
+    Space average(const Space& a, const Space& b) {
+        // Averaging equal spaces would not give them back exactly, which would split them later
+        if (a.magS == b.magS && a.magT == b.magT && equal(a.os, b.os) && equal(a.ot, b.ot))
+            return a;
+        Space result;
+        result.magS = 0.5f * (a.magS + b.magS);
+        result.magT = 0.5f * (a.magT + b.magT);
+        result.os = add(a.os, b.os);
+        result.ot = add(a.ot, b.ot);
+        if (notZero(result.os))
+            result.os = normalize(result.os);
+        if (notZero(result.ot))
+            result.ot = normalize(result.ot);
+        return result;
+    }
+
+    // Which edge of the triangle (a, b) is, and its vertices in triangle order.
+    int getEdge(const uint32_t* vertices, uint32_t a, uint32_t b, uint32_t& i0, uint32_t& i1) {
+        if (vertices[0] == a || vertices[0] == b) {
+            if (vertices[1] == a || vertices[1] == b) {
+                i0 = vertices[0];
+                i1 = vertices[1];
+                return 0;
+            }
+            i0 = vertices[2];
+            i1 = vertices[0];
+            return 2;
+        }
+        i0 = vertices[1];
+        i1 = vertices[2];
+        return 1;
+    }
+
+    class Generator {
+    public:
+        Generator(const TT_FBX::CornerGeometry& geometry) : geometry(geometry) {}
+
+        std::vector<float> generate() {
+            size_t cornerCount = geometry.positions.size() / 3;
+            std::vector<float> result(cornerCount * 4, 0.0f);
+            buildFaces();
+            buildTriangles();
+            if (triangles.empty())
+                return result;
+            weldVertices();
+            removeDegenerateTriangles();
+            initTriangles();
+            buildGroups();
+            spaces.resize(faceCorners.size());
+            generateSpaces();
+            fixDegenerateTriangles();
+
+            // A corner of a polygon with more than 4 corners is in several of its fan triangles, the first one sets it
+            std::vector<bool> written(cornerCount);
+            for (size_t vertex = 0; vertex < faceCorners.size(); ++vertex) {
+                if (vertex % 4 >= faceSizes[vertex / 4] || written[faceCorners[vertex]])
+                    continue;
+                uint32_t corner = faceCorners[vertex];
+                written[corner] = true;
+                result[corner * 4] = spaces[vertex].os.x;
+                result[corner * 4 + 1] = spaces[vertex].os.y;
+                result[corner * 4 + 2] = spaces[vertex].os.z;
+                result[corner * 4 + 3] = spaces[vertex].orientPreserving ? 1.0f : -1.0f;
+            }
+            return result;
+        }
+
+    private:
+        const TT_FBX::CornerGeometry& geometry;
+        // MikkTSpace takes triangles and quads, face vertex v of face f is f * 4 + v.
+        std::vector<uint32_t> faceCorners;
+        std::vector<uint8_t> faceSizes;
+        std::vector<Triangle> triangles;
+        // Three face vertices per triangle, welded after weldVertices.
+        std::vector<uint32_t> triangleVertices;
+        uint32_t goodTriangleCount = 0;
+        std::vector<Group> groups;
+        std::vector<uint32_t> groupTriangles;
+        // Per face vertex.
+        std::vector<Space> spaces;
+
+        Vec3 position(uint32_t vertex) const {
+            const float* p = &geometry.positions[faceCorners[vertex] * 3];
+            return { p[0], p[1], p[2] };
+        }
+
+        Vec3 normal(uint32_t vertex) const {
+            const float* n = &geometry.normals[faceCorners[vertex] * 3];
+            return { n[0], n[1], n[2] };
+        }
+
+        Vec3 texCoord(uint32_t vertex) const {
+            const float* t = &geometry.uvs[faceCorners[vertex] * 2];
+            return { t[0], t[1], 1.0f };
+        }
+
+        float texArea(const uint32_t* vertices) const {
+            Vec3 t1 = texCoord(vertices[0]);
+            Vec3 t2 = texCoord(vertices[1]);
+            Vec3 t3 = texCoord(vertices[2]);
+            float area = (t2.x - t1.x) * (t3.y - t1.y) - (t2.y - t1.y) * (t3.x - t1.x);
+            return area < 0.0f ? -area : area;
+        }
+
+        // Triangles and quads are faces as they are, larger polygons are triangulated as fans like extractMesh does.
+        void buildFaces() {
+            size_t polygonCount = geometry.polygonOffsets.empty() ? 0 : geometry.polygonOffsets.size() - 1;
+            for (size_t polygon = 0; polygon < polygonCount; ++polygon) {
+                uint32_t first = geometry.polygonOffsets[polygon];
+                uint32_t last = geometry.polygonOffsets[polygon + 1];
+                if (last - first == 3 || last - first == 4) {
+                    for (uint32_t i = 0; i < 4; ++i)
+                        faceCorners.push_back(first + std::min(i, last - first - 1));
+                    faceSizes.push_back((uint8_t)(last - first));
+                    continue;
+                }
+                for (uint32_t corner = first + 2; corner < last; ++corner) {
+                    faceCorners.insert(faceCorners.end(), { first, corner - 1, corner, corner });
+                    faceSizes.push_back(3);
+                }
+            }
+        }
+
+        void addTriangle(uint32_t face, uint8_t a, uint8_t b, uint8_t c) {
+            Triangle triangle;
+            triangle.face = face;
+            triangle.vertices[0] = a;
+            triangle.vertices[1] = b;
+            triangle.vertices[2] = c;
+            triangles.push_back(triangle);
+            triangleVertices.insert(triangleVertices.end(), { face * 4 + a, face * 4 + b, face * 4 + c });
+        }
+
+        // Quads are split along their shortest diagonal, so the result does not depend on their first vertex.
+        void buildTriangles() {
+            for (uint32_t face = 0; face < (uint32_t)faceSizes.size(); ++face) {
+                if (faceSizes[face] == 3) {
+                    addTriangle(face, 0, 1, 2);
+                    continue;
+                }
+                uint32_t base = face * 4;
+                float distance02 = lengthSquared(sub(texCoord(base + 2), texCoord(base)));
+                float distance13 = lengthSquared(sub(texCoord(base + 3), texCoord(base + 1)));
+                bool diagonal02;
+                if (distance02 < distance13) {
+                    diagonal02 = true;
+                } else if (distance13 < distance02) {
+                    diagonal02 = false;
+                } else {
+                    float positionDistance02 = lengthSquared(sub(position(base + 2), position(base)));
+                    float positionDistance13 = lengthSquared(sub(position(base + 3), position(base + 1)));
+                    diagonal02 = !(positionDistance13 < positionDistance02);
+                }
+                if (diagonal02) {
+                    addTriangle(face, 0, 1, 2);
+                    addTriangle(face, 0, 2, 3);
+                } else {
+                    addTriangle(face, 0, 1, 3);
+                    addTriangle(face, 1, 2, 3);
+                }
+            }
+        }
+
+        // Replace every face vertex by the first one with an identical position, normal and uv.
+        void weldVertices() {
+            std::unordered_map<std::string_view, uint32_t> welded;
+            std::vector<float> keys(triangleVertices.size() * 8);
+            TT_FBX::parallelFor(triangleVertices.size(), [&](size_t i) {
+                Vec3 p = position(triangleVertices[i]);
+                Vec3 n = normal(triangleVertices[i]);
+                Vec3 t = texCoord(triangleVertices[i]);
+                // Adding 0 turns -0 into 0, which compare equal but differ in their bytes
+                float key[8] = { p.x + 0.0f, p.y + 0.0f, p.z + 0.0f, n.x + 0.0f, n.y + 0.0f, n.z + 0.0f, t.x + 0.0f, t.y + 0.0f };
+                memcpy(&keys[i * 8], key, sizeof(key));
+            });
+            for (size_t i = 0; i < triangleVertices.size(); ++i)
+                triangleVertices[i] = welded.emplace(std::string_view((const char*)&keys[i * 8], sizeof(float) * 8), triangleVertices[i]).first->second;
+        }
+
+        // Degenerate triangles move behind the good ones, which keep their order.
+        void removeDegenerateTriangles() {
+            TT_FBX::parallelFor(triangles.size(), [&](size_t t) {
+                Vec3 p0 = position(triangleVertices[t * 3]);
+                Vec3 p1 = position(triangleVertices[t * 3 + 1]);
+                Vec3 p2 = position(triangleVertices[t * 3 + 2]);
+                if (equal(p0, p1) || equal(p0, p2) || equal(p1, p2))
+                    triangles[t].flags |= MARK_DEGENERATE;
+            });
+
+            for (size_t t = 0; t + 1 < triangles.size();) {
+                if (triangles[t].face != triangles[t + 1].face) {
+                    ++t;
+                    continue;
+                }
+                if ((triangles[t].flags & MARK_DEGENERATE) != (triangles[t + 1].flags & MARK_DEGENERATE)) {
+                    triangles[t].flags |= QUAD_ONE_DEGENERATE_TRIANGLE;
+                    triangles[t + 1].flags |= QUAD_ONE_DEGENERATE_TRIANGLE;
+                }
+                t += 2;
+            }
+
+            std::vector<uint32_t> order(triangles.size());
+            for (uint32_t t = 0; t < (uint32_t)order.size(); ++t)
+                order[t] = t;
+            goodTriangleCount = (uint32_t)(std::stable_partition(order.begin(), order.end(), [&](uint32_t t) {
+                return (triangles[t].flags & MARK_DEGENERATE) == 0;
+            }) - order.begin());
+            std::vector<Triangle> sortedTriangles(triangles.size());
+            std::vector<uint32_t> sortedVertices(triangleVertices.size());
+            for (size_t t = 0; t < order.size(); ++t) {
+                sortedTriangles[t] = triangles[order[t]];
+                memcpy(&sortedVertices[t * 3], &triangleVertices[order[t] * 3], sizeof(uint32_t) * 3);
+            }
+            triangles.swap(sortedTriangles);
+            triangleVertices.swap(sortedVertices);
+        }
+
+        // The uv gradients of every good triangle, and which triangles share an edge.
+        void initTriangles() {
+            TT_FBX::parallelFor(goodTriangleCount, [&](size_t t) {
+                Triangle& triangle = triangles[t];
+                triangle.flags |= GROUP_WITH_ANY;
+                const uint32_t* vertices = &triangleVertices[t * 3];
+                Vec3 v1 = position(vertices[0]);
+                Vec3 t1 = texCoord(vertices[0]);
+                Vec3 t2 = texCoord(vertices[1]);
+                Vec3 t3 = texCoord(vertices[2]);
+                float t21x = t2.x - t1.x;
+                float t21y = t2.y - t1.y;
+                float t31x = t3.x - t1.x;
+                float t31y = t3.y - t1.y;
+                Vec3 d1 = sub(position(vertices[1]), v1);
+                Vec3 d2 = sub(position(vertices[2]), v1);
+
+                float signedArea = t21x * t31y - t21y * t31x;
+                Vec3 os = sub(scale(t31y, d1), scale(t21y, d2));
+                Vec3 ot = add(scale(-t31x, d1), scale(t21x, d2));
+                triangle.flags |= signedArea > 0.0f ? ORIENT_PRESERVING : 0;
+                if (!notZero(signedArea))
+                    return;
+
+                float absArea = fabsf(signedArea);
+                float lengthOs = length(os);
+                float lengthOt = length(ot);
+                float sign = (triangle.flags & ORIENT_PRESERVING) == 0 ? -1.0f : 1.0f;
+                if (notZero(lengthOs))
+                    triangle.os = scale(sign / lengthOs, os);
+                if (notZero(lengthOt))
+                    triangle.ot = scale(sign / lengthOt, ot);
+                triangle.magS = lengthOs / absArea;
+                triangle.magT = lengthOt / absArea;
+                if (notZero(triangle.magS) && notZero(triangle.magT))
+                    triangle.flags &= ~GROUP_WITH_ANY;
+            });
+
+            // Both triangles of a healthy quad get the orientation of the one with the larger uv area
+            for (uint32_t t = 0; t + 1 < goodTriangleCount;) {
+                if (triangles[t].face != triangles[t + 1].face) {
+                    ++t;
+                    continue;
+                }
+                bool orientA = (triangles[t].flags & ORIENT_PRESERVING) != 0;
+                bool orientB = (triangles[t + 1].flags & ORIENT_PRESERVING) != 0;
+                if (orientA != orientB) {
+                    bool first = (triangles[t + 1].flags & GROUP_WITH_ANY) != 0 ||
+                        texArea(&triangleVertices[t * 3]) >= texArea(&triangleVertices[(t + 1) * 3]);
+                    const Triangle& source = triangles[first ? t : t + 1];
+                    Triangle& target = triangles[first ? t + 1 : t];
+                    target.flags = (target.flags & ~ORIENT_PRESERVING) | (source.flags & ORIENT_PRESERVING);
+                }
+                t += 2;
+            }
+            buildNeighbors();
+        }
+
+        // Pair up triangles with opposite edges. An edge of more than two triangles pairs them in triangle order.
+        void buildNeighbors() {
+            std::vector<Edge> edges(goodTriangleCount * 3);
+            for (uint32_t t = 0; t < goodTriangleCount; ++t) {
+                for (uint32_t i = 0; i < 3; ++i) {
+                    uint32_t i0 = triangleVertices[t * 3 + i];
+                    uint32_t i1 = triangleVertices[t * 3 + (i < 2 ? i + 1 : 0)];
+                    edges[t * 3 + i] = { std::min(i0, i1), std::max(i0, i1), t };
+                }
+            }
+            std::sort(edges.begin(), edges.end(), [](const Edge& a, const Edge& b) {
+                return a.i0 != b.i0 ? a.i0 < b.i0 : a.i1 != b.i1 ? a.i1 < b.i1 : a.triangle < b.triangle;
+            });
+
+            for (size_t i = 0; i < edges.size(); ++i) {
+                uint32_t i0A, i1A;
+                uint32_t a = edges[i].triangle;
+                int edgeA = getEdge(&triangleVertices[a * 3], edges[i].i0, edges[i].i1, i0A, i1A);
+                if (triangles[a].neighbors[edgeA] != -1)
+                    continue;
+                for (size_t j = i + 1; j < edges.size() && edges[j].i0 == edges[i].i0 && edges[j].i1 == edges[i].i1; ++j) {
+                    uint32_t i0B, i1B;
+                    uint32_t b = edges[j].triangle;
+                    // The neighbor runs the other way
+                    int edgeB = getEdge(&triangleVertices[b * 3], edges[j].i0, edges[j].i1, i1B, i0B);
+                    if (i0A == i0B && i1A == i1B && triangles[b].neighbors[edgeB] == -1) {
+                        triangles[a].neighbors[edgeA] = (int)b;
+                        triangles[b].neighbors[edgeB] = (int)a;
+                        break;
+                    }
+                }
+            }
+        }
+
+        // Add triangle to group and walk on to its neighbors around the group vertex, depth first.
+        void assignGroup(uint32_t triangle, int group) {
+            std::vector<uint32_t> stack = { triangle };
+            while (!stack.empty()) {
+                uint32_t t = stack.back();
+                stack.pop_back();
+                Triangle& current = triangles[t];
+                const uint32_t* vertices = &triangleVertices[t * 3];
+                int i = vertices[0] == groups[group].vertex ? 0 : vertices[1] == groups[group].vertex ? 1 : 2;
+                if (current.groups[i] != -1)
+                    continue;
+                // The first group to reach a group-with-any triangle decides its orientation, the one order dependency of MikkTSpace
+                if ((current.flags & GROUP_WITH_ANY) != 0 && current.groups[0] == -1 && current.groups[1] == -1 && current.groups[2] == -1)
+                    current.flags = (current.flags & ~ORIENT_PRESERVING) | (groups[group].orientPreserving ? ORIENT_PRESERVING : 0);
+                if (((current.flags & ORIENT_PRESERVING) != 0) != groups[group].orientPreserving)
+                    continue;
+
+                groupTriangles.push_back(t);
+                groups[group].count++;
+                current.groups[i] = group;
+                // Pushed in reverse, so the left neighbor is walked first
+                int right = current.neighbors[i > 0 ? i - 1 : 2];
+                int left = current.neighbors[i];
+                if (right >= 0)
+                    stack.push_back((uint32_t)right);
+                if (left >= 0)
+                    stack.push_back((uint32_t)left);
+            }
+        }
+
+        void buildGroups() {
+            for (uint32_t t = 0; t < goodTriangleCount; ++t) {
+                for (int i = 0; i < 3; ++i) {
+                    if ((triangles[t].flags & GROUP_WITH_ANY) != 0 || triangles[t].groups[i] != -1)
+                        continue;
+                    Group group;
+                    group.first = (uint32_t)groupTriangles.size();
+                    group.vertex = triangleVertices[t * 3 + i];
+                    group.orientPreserving = (triangles[t].flags & ORIENT_PRESERVING) != 0;
+                    groups.push_back(group);
+                    assignGroup(t, (int)groups.size() - 1);
+                }
+            }
+        }
+
+        // Angle weighted average of the tangents of some triangles of a group, at the group vertex.
+        Space evaluateSpace(const uint32_t* members, size_t count, uint32_t vertex) const {
+            Space result;
+            result.os = Vec3();
+            result.ot = Vec3();
+            result.magS = 0.0f;
+            result.magT = 0.0f;
+            float angleSum = 0.0f;
+            for (size_t m = 0; m < count; ++m) {
+                uint32_t t = members[m];
+                const Triangle& triangle = triangles[t];
+                if ((triangle.flags & GROUP_WITH_ANY) != 0)
+                    continue;
+                const uint32_t* vertices = &triangleVertices[t * 3];
+                int i = vertices[0] == vertex ? 0 : vertices[1] == vertex ? 1 : 2;
+                Vec3 n = normal(vertices[i]);
+                Vec3 os = projectNormalized(triangle.os, n);
+                Vec3 ot = projectNormalized(triangle.ot, n);
+
+                Vec3 p0 = position(vertices[i > 0 ? i - 1 : 2]);
+                Vec3 p1 = position(vertices[i]);
+                Vec3 p2 = position(vertices[i < 2 ? i + 1 : 0]);
+                Vec3 v1 = projectNormalized(sub(p0, p1), n);
+                Vec3 v2 = projectNormalized(sub(p2, p1), n);
+                float cosine = std::min(1.0f, std::max(-1.0f, dot(v1, v2)));
+                float angle = (float)acos((double)cosine);
+
+                result.os = add(result.os, scale(angle, os));
+                result.ot = add(result.ot, scale(angle, ot));
+                result.magS += angle * triangle.magS;
+                result.magT += angle * triangle.magT;
+                angleSum += angle;
+            }
+            if (notZero(result.os))
+                result.os = normalize(result.os);
+            if (notZero(result.ot))
+                result.ot = normalize(result.ot);
+            if (angleSum > 0.0f) {
+                result.magS /= angleSum;
+                result.magT /= angleSum;
+            }
+            return result;
+        }
+
+        // Every group is split into subgroups of triangles whose tangents are within the angular threshold of each other,
+        // and every corner gets the space of its subgroup. Groups are independent, so they are evaluated in parallel.
+        void generateSpaces() {
+            const float thresholdCos = (float)cos((180.0f * 3.14159265f) / 180.0f);
+            std::vector<Space> memberSpaces(groupTriangles.size());
+            size_t taskCount = (groups.size() + GROUPS_PER_TASK - 1) / GROUPS_PER_TASK;
+            TT_FBX::parallelFor(taskCount, [&](size_t task) {
+                std::vector<Vec3> projected;
+                std::vector<uint32_t> members;
+                std::vector<std::vector<uint32_t>> subGroups;
+                std::vector<Space> subGroupSpaces;
+                size_t lastGroup = std::min(groups.size(), (task + 1) * GROUPS_PER_TASK);
+                for (size_t g = task * GROUPS_PER_TASK; g < lastGroup; ++g) {
+                    const Group& group = groups[g];
+                    const uint32_t* groupMembers = &groupTriangles[group.first];
+                    // The group vertex is welded, so every member has the same normal there
+                    Vec3 n = normal(group.vertex);
+                    projected.resize(group.count * 2);
+                    for (uint32_t m = 0; m < group.count; ++m) {
+                        projected[m * 2] = projectNormalized(triangles[groupMembers[m]].os, n);
+                        projected[m * 2 + 1] = projectNormalized(triangles[groupMembers[m]].ot, n);
+                    }
+
+                    subGroups.clear();
+                    subGroupSpaces.clear();
+                    for (uint32_t m = 0; m < group.count; ++m) {
+                        const Triangle& triangle = triangles[groupMembers[m]];
+                        members.clear();
+                        for (uint32_t other = 0; other < group.count; ++other) {
+                            const Triangle& otherTriangle = triangles[groupMembers[other]];
+                            bool any = ((triangle.flags | otherTriangle.flags) & GROUP_WITH_ANY) != 0;
+                            // Triangles of the same quad are always joined
+                            bool sameFace = triangle.face == otherTriangle.face;
+                            float cosS = dot(projected[m * 2], projected[other * 2]);
+                            float cosT = dot(projected[m * 2 + 1], projected[other * 2 + 1]);
+                            if (any || sameFace || (cosS > thresholdCos && cosT > thresholdCos))
+                                members.push_back(groupMembers[other]);
+                        }
+                        std::sort(members.begin(), members.end());
+
+                        size_t subGroup = std::find(subGroups.begin(), subGroups.end(), members) - subGroups.begin();
+                        if (subGroup == subGroups.size()) {
+                            subGroups.push_back(members);
+                            subGroupSpaces.push_back(evaluateSpace(members.data(), members.size(), group.vertex));
+                        }
+                        memberSpaces[group.first + m] = subGroupSpaces[subGroup];
+                    }
+                }
+            });
+
+            // The two triangles of a quad share two of its vertices, possibly from different groups, those average their spaces
+            for (int g = 0; g < (int)groups.size(); ++g) {
+                const Group& group = groups[g];
+                for (uint32_t m = 0; m < group.count; ++m) {
+                    const Triangle& triangle = triangles[groupTriangles[group.first + m]];
+                    int i = triangle.groups[0] == g ? 0 : triangle.groups[1] == g ? 1 : 2;
+                    Space& space = spaces[triangle.face * 4 + triangle.vertices[i]];
+                    const Space& memberSpace = memberSpaces[group.first + m];
+                    if (space.counter == 1) {
+                        space = average(space, memberSpace);
+                        space.counter = 2;
+                    } else {
+                        space = memberSpace;
+                        space.counter = 1;
+                    }
+                    space.orientPreserving = group.orientPreserving;
+                }
+            }
+        }
+
+        // Degenerate triangles copy the space of the first good triangle corner with the same welded vertex. The good triangle
+        // of a quad whose other triangle is degenerate gives its missing vertex the space of a vertex at the same position.
+        void fixDegenerateTriangles() {
+            std::unordered_map<uint32_t, uint32_t> firstGoodCorner;
+            for (uint32_t j = 0; j < goodTriangleCount * 3; ++j)
+                firstGoodCorner.emplace(triangleVertices[j], j);
+            for (size_t t = goodTriangleCount; t < triangles.size(); ++t) {
+                if ((triangles[t].flags & QUAD_ONE_DEGENERATE_TRIANGLE) != 0)
+                    continue;
+                for (int i = 0; i < 3; ++i) {
+                    auto found = firstGoodCorner.find(triangleVertices[t * 3 + i]);
+                    if (found == firstGoodCorner.end())
+                        continue;
+                    const Triangle& source = triangles[found->second / 3];
+                    spaces[triangles[t].face * 4 + triangles[t].vertices[i]] = spaces[source.face * 4 + source.vertices[found->second % 3]];
+                }
+            }
+
+            for (uint32_t t = 0; t < goodTriangleCount; ++t) {
+                const Triangle& triangle = triangles[t];
+                if ((triangle.flags & QUAD_ONE_DEGENERATE_TRIANGLE) == 0)
+                    continue;
+                int present = (1 << triangle.vertices[0]) | (1 << triangle.vertices[1]) | (1 << triangle.vertices[2]);
+                uint32_t missing = (present & 2) == 0 ? 1 : (present & 4) == 0 ? 2 : (present & 8) == 0 ? 3 : 0;
+                uint32_t base = triangle.face * 4;
+                Vec3 missingPosition = position(base + missing);
+                for (int i = 0; i < 3; ++i) {
+                    if (equal(position(base + triangle.vertices[i]), missingPosition)) {
+                        spaces[base + missing] = spaces[base + triangle.vertices[i]];
+                        break;
+                    }
+                }
+            }
+        }
+    };
+}
+
+namespace TT_FBX {
+    std::vector<float> generateTangents(const CornerGeometry& geometry) {
+        return Generator(geometry).generate();
+    }
+}
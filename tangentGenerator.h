@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace TT_FBX {
+    // Per polygon vertex (corner) data of a mesh, before deduplication. This is the layout
+    // FBX uses for eByPolygonVertex layer elements, so corner c of polygon p is polygonOffsets[p] + c.
+    struct CornerGeometry {
+        // Corners of polygon p are polygonOffsets[p] up to polygonOffsets[p + 1].
+        std::vector<uint32_t> polygonOffsets;
+        // Control point (FBX vertex) per corner.
+        std::vector<uint32_t> controlPoints;
+        // 3 floats per corner.
+        std::vector<float> positions;
+        // 3 floats per corner, expected to be normalized. Empty if the mesh has none and they are not generated.
+        std::vector<float> normals;
+        // 2 floats per corner, empty if the mesh has no uvs.
+        std::vector<float> uvs;
+    };
+
+    // Generate MikkTSpace tangents, 4 floats per corner: a unit tangent followed by the bitangent sign,
+    // so that bitangent = sign * cross(normal, tangent). Needs normals and uvs.
+    //
+    // Triangles and quads are passed to MikkTSpace as they are, larger polygons as the triangles of a fan around
+    // their first corner, like extractMesh triangulates them. Polygons with less than 3 corners get a zero tangent.
+    // Identical input corners get identical tangents, so they still deduplicate afterwards.
+    std::vector<float> generateTangents(const CornerGeometry& geometry);
+}
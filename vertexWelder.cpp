@@ -0,0 +1,162 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "vertexWelder.h"
+
+namespace {
+    constexpr uint32_t NO_VERTEX = ~0u;
+
+    // Cells are much larger than the tolerance, so the search reaches into a neighbouring cell for few points,
+    // while vertices are usually spaced far enough apart that a cell holds only one or two of them.
+    constexpr float CELLS_PER_TOLERANCE = 16.0f;
+    // Cell size when positions must match exactly, identical positions still share a cell.
+    constexpr float MIN_CELL_SIZE = 1e-6f;
+
+    inline const float* readFloats(const uint8_t* vertex, const TT_FBX::WeldAttribute& attribute) {
+        return (const float*)(vertex + attribute.offset);
+    }
+
+    bool isWithinTolerance(const uint8_t* a, const uint8_t* b, const std::vector<TT_FBX::WeldAttribute>& attributes, const TT_FBX::WeldTolerance& tolerance) {
+        for (const TT_FBX::WeldAttribute& attribute : attributes) {
+            const float* x = readFloats(a, attribute);
+            const float* y = readFloats(b, attribute);
+            switch (attribute.compare) {
+            case TT_FBX::WeldCompare::Exact:
+                if (memcmp(x, y, attribute.components * sizeof(float)) != 0)
+                    return false;
+                break;
+            case TT_FBX::WeldCompare::Distance: {
+                float distanceSquared = 0.0f;
+                for (uint32_t i = 0; i < attribute.components; ++i)
+                    distanceSquared += (x[i] - y[i]) * (x[i] - y[i]);
+                if (distanceSquared > tolerance.position * tolerance.position)
+                    return false;
+                break;
+            }
+            case TT_FBX::WeldCompare::Angle: {
+                float dot = x[0] * y[0] + x[1] * y[1] + x[2] * y[2];
+                float lengths = sqrtf((x[0] * x[0] + x[1] * x[1] + x[2] * x[2]) * (y[0] * y[0] + y[1] * y[1] + y[2] * y[2]));
+                if (dot < tolerance.normalCosine * lengths)
+                    return false;
+                if (attribute.components > 3 && memcmp(x + 3, y + 3, (attribute.components - 3) * sizeof(float)) != 0)
+                    return false;
+                break;
+            }
+            case TT_FBX::WeldCompare::Absolute:
+                for (uint32_t i = 0; i < attribute.components; ++i) {
+                    if (fabsf(x[i] - y[i]) > tolerance.absolute)
+                        return false;
+                }
+                break;
+            }
+        }
+        return true;
+    }
+
+    inline uint64_t cellKey(int64_t x, int64_t y, int64_t z) {
+        return (uint64_t)x * 73856093ull ^ (uint64_t)y * 19349663ull ^ (uint64_t)z * 83492791ull;
+    }
+
+    // Open addressing table from cell key to the newest vertex kept in that cell. Cells that collide on the key
+    // share a list, which only costs a few extra comparisons since candidates are checked by distance anyway.
+    struct CellTable {
+        std::vector<uint64_t> keys;
+        std::vector<uint32_t> heads;
+        uint64_t mask = 0;
+
+        explicit CellTable(size_t capacity) {
+            size_t size = 16;
+            while (size < capacity * 2)
+                size *= 2;
+            keys.resize(size);
+            heads.assign(size, NO_VERTEX);
+            mask = size - 1;
+        }
+
+        // Slot of the key, or the empty slot where it belongs.
+        size_t find(uint64_t key) const {
+            size_t slot = (size_t)((key ^ (key >> 29)) * 0x9E3779B97F4A7C15ull >> 17) & mask;
+            while (heads[slot] != NO_VERTEX && keys[slot] != key)
+                slot = (slot + 1) & mask;
+            return slot;
+        }
+    };
+
+    inline int64_t cellCoordinate(float value, float inverseCellSize) {
+        // Non finite positions all go to cell 0, they only ever match bitwise equal vertices through Exact attributes
+        float cell = floorf(value * inverseCellSize);
+        return std::isfinite(cell) ? (int64_t)cell : 0;
+    }
+}
+
+namespace TT_FBX {
+    size_t weldVertices(std::vector<uint8_t>& vertexData, size_t stride, const std::vector<WeldAttribute>& attributes, const WeldTolerance& tolerance, const uint32_t* keys, std::vector<uint32_t>& remap) {
+        size_t vertexCount = vertexData.size() / stride;
+        remap.assign(vertexCount, NO_VERTEX);
+
+        float cellSize = std::max(tolerance.position * CELLS_PER_TOLERANCE, MIN_CELL_SIZE);
+        float inverseCellSize = 1.0f / cellSize;
+
+        // Each cell holds a linked list of the vertices that were kept, newest first
+        CellTable cells(vertexCount);
+        std::vector<uint32_t> next(vertexCount, NO_VERTEX);
+
+        size_t keptCount = 0;
+        for (uint32_t vertex = 0; vertex < (uint32_t)vertexCount; ++vertex) {
+            const uint8_t* data = vertexData.data() + vertex * stride;
+            float position[3];
+            memcpy(position, data, sizeof(position));
+
+            // Only the cells within reach of the tolerance are searched
+            int64_t low[3];
+            int64_t high[3];
+            for (int i = 0; i < 3; ++i) {
+                low[i] = cellCoordinate(position[i] - tolerance.position, inverseCellSize);
+                high[i] = cellCoordinate(position[i] + tolerance.position, inverseCellSize);
+            }
+
+            uint32_t match = NO_VERTEX;
+            for (int64_t x = low[0]; x <= high[0] && match == NO_VERTEX; ++x) {
+                for (int64_t y = low[1]; y <= high[1] && match == NO_VERTEX; ++y) {
+                    for (int64_t z = low[2]; z <= high[2] && match == NO_VERTEX; ++z) {
+                        size_t slot = cells.find(cellKey(x, y, z));
+                        for (uint32_t candidate = cells.heads[slot]; candidate != NO_VERTEX; candidate = next[candidate]) {
+                            if (keys && keys[candidate] != keys[vertex])
+                                continue;
+                            if (isWithinTolerance(vertexData.data() + candidate * stride, data, attributes, tolerance)) {
+                                match = candidate;
+                                break;
+                            }
+                        }
+                    }
+                }
+            }
+
+            if (match != NO_VERTEX) {
+                remap[vertex] = remap[match];
+                continue;
+            }
+
+            uint64_t key = cellKey(cellCoordinate(position[0], inverseCellSize), cellCoordinate(position[1], inverseCellSize), cellCoordinate(position[2], inverseCellSize));
+            size_t slot = cells.find(key);
+            cells.keys[slot] = key;
+            next[vertex] = cells.heads[slot];
+            cells.heads[slot] = vertex;
+            remap[vertex] = (uint32_t)keptCount++;
+        }
+
+        // A vertex was kept when it got the next new index, merged ones point back at an earlier vertex.
+        // Kept vertices only move towards the front, so compacting in place is safe.
+        uint32_t cursor = 0;
+        for (uint32_t vertex = 0; vertex < (uint32_t)vertexCount; ++vertex) {
+            if (remap[vertex] != cursor)
+                continue;
+            if (cursor != vertex)
+                memcpy(vertexData.data() + cursor * stride, vertexData.data() + vertex * stride, stride);
+            cursor++;
+        }
+        vertexData.resize(keptCount * stride);
+        return vertexCount - keptCount;
+    }
+}
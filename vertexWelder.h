@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace TT_FBX {
+    // How two values of an attribute are compared when welding.
+    enum class WeldCompare : uint8_t {
+        // Bitwise equal, for integers like skin indices.
+        Exact,
+        // Euclidean distance within WeldTolerance::position, for the position.
+        Distance,
+        // Angle between the xyz directions within WeldTolerance::normalCosine, a 4th component must be equal.
+        Angle,
+        // Every component within WeldTolerance::absolute, for uvs, colors and skin weights.
+        Absolute,
+    };
+
+    // An attribute of an interleaved vertex made of 4 byte components.
+    struct WeldAttribute {
+        uint32_t offset = 0;
+        uint32_t components = 0;
+        WeldCompare compare = WeldCompare::Exact;
+    };
+
+    struct WeldTolerance {
+        float position = 0.0f;
+        // Cosine of the largest angle between directions.
+        float normalCosine = 1.0f;
+        float absolute = 0.0f;
+    };
+
+    // Merge vertices whose attributes all match within the tolerances, the first vertex of a group is kept.
+    // Candidates are found with a uniform grid over the positions, which must be the float3 at offset 0,
+    // so the cost stays close to linear. Vertices with different keys are never merged, keys may be nullptr.
+    // The vertex data is compacted in place, remap maps every old vertex to its new index. Returns the number of merged vertices.
+    size_t weldVertices(std::vector<uint8_t>& vertexData, size_t stride, const std::vector<WeldAttribute>& attributes, const WeldTolerance& tolerance, const uint32_t* keys, std::vector<uint32_t>& remap);
+}